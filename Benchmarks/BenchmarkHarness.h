@@ -0,0 +1,73 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+/*
+    Minimal timing harness: runs a batch until it takes long enough to measure,
+    then reports the best of a few repetitions as ns/op and MB/s.
+*/
+
+namespace Bench {
+    template <class T> inline void doNotOptimize(const T &value) {
+#if defined(_MSC_VER)
+        static volatile const void *sink;
+        sink = &value;
+#else
+        asm volatile("" : : "r,m"(value) : "memory");
+#endif
+    }
+
+    inline void clobberMemory() {
+#if !defined(_MSC_VER)
+        asm volatile("" : : : "memory");
+#endif
+    }
+
+    struct Options {
+        const char *filter = nullptr;
+        double minSeconds = 0.05;
+        int repetitions = 5;
+    };
+
+    inline Options &options() {
+        static Options instance;
+        return instance;
+    }
+
+    // batch(n) performs n operations touching bytesPerOp bytes each
+    template <class F> void run(const std::string &name, size_t bytesPerOp, F &&batch) {
+        const Options &opts = options();
+        if (opts.filter && name.find(opts.filter) == std::string::npos)
+            return;
+
+        typedef std::chrono::steady_clock Clock;
+        size_t iterations = 1024;
+        for (;;) {
+            Clock::time_point start = Clock::now();
+            batch(iterations);
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            if (seconds >= opts.minSeconds || iterations >= (size_t(1) << 34))
+                break;
+            iterations *= seconds > 0.001 ? (size_t)(opts.minSeconds / seconds) + 1 : 16;
+        }
+
+        double best = 1e300;
+        for (int rep = 0; rep < opts.repetitions; ++rep) {
+            Clock::time_point start = Clock::now();
+            batch(iterations);
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            if (seconds < best)
+                best = seconds;
+        }
+
+        const double nsPerOp = best * 1e9 / iterations;
+        if (bytesPerOp > 0) {
+            const double mbPerSecond = (double)bytesPerOp * iterations / best / 1e6;
+            printf("%-48s %10.2f ns/op %12.1f MB/s\n", name.c_str(), nsPerOp, mbPerSecond);
+        } else {
+            printf("%-48s %10.2f ns/op\n", name.c_str(), nsPerOp);
+        }
+    }
+}
@@ -0,0 +1,485 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "BenchmarkHarness.h"
+#include "Buffer.h"
+#include "PacketFramer.h"
+#include "RVLCodec.h"
+#include "SimlyProtocol.h"
+
+#include <cstdlib>
+#include <vector>
+
+/*
+    Serialization benchmarks: every Buffer/BufferView width and endianness,
+    byteStr, and encode/decode of each Simly packet type.
+
+    RVL depth compression is checked before it is timed (round trip, truncated and corrupt
+    input), a failed check makes the run exit with EXIT_FAILURE.
+*/
+
+// Values written/read per batch before the buffer is reset, keeps the working set in L1
+static const size_t ValuesPerRound = 2048;
+
+// Typical TCP segment payload, used to feed the framer like a socket would
+static const size_t SegmentSize = 1460;
+
+// Samples per ForceBatch packet, a 1 kHz sensor sending 50 packets per second
+static const size_t SamplesPerBatch = 20;
+
+/************************** Reader/writer widths ***************************/
+
+template <class T, class WriteBuffer, class ReadBuffer, class WriteView, class ReadView>
+static void benchWidth(const char *name, WriteBuffer writeBuffer, ReadBuffer readBuffer, WriteView writeView, ReadView readView) {
+    const std::string suffix = std::string("/") + name;
+
+    {
+        Buffer buffer;
+        Bench::run("Buffer/write" + suffix, sizeof(T), [&](size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                if (i % ValuesPerRound == 0)
+                    buffer.clear();
+                writeBuffer(buffer, (T)i);
+            }
+            Bench::doNotOptimize(buffer);
+        });
+
+        buffer.clear();
+        for (size_t i = 0; i < ValuesPerRound; ++i)
+            writeBuffer(buffer, (T)i);
+        Bench::run("Buffer/read" + suffix, sizeof(T), [&](size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                if (i % ValuesPerRound == 0)
+                    buffer.setReadOffset(0);
+                T value = readBuffer(buffer);
+                Bench::doNotOptimize(value);
+            }
+        });
+    }
+
+    {
+        std::vector<unsigned char> storage(ValuesPerRound * sizeof(T));
+        BufferView view(storage.data(), storage.size());
+        Bench::run("BufferView/write" + suffix, sizeof(T), [&](size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                if (i % ValuesPerRound == 0)
+                    view.clear();
+                writeView(view, (T)i);
+            }
+            Bench::clobberMemory();
+        });
+
+        view.clear();
+        for (size_t i = 0; i < ValuesPerRound; ++i)
+            writeView(view, (T)i);
+        Bench::run("BufferView/read" + suffix, sizeof(T), [&](size_t n) {
+            for (size_t i = 0; i < n; ++i) {
+                if (i % ValuesPerRound == 0)
+                    view.setReadOffset(0);
+                T value = readView(view);
+                Bench::doNotOptimize(value);
+            }
+        });
+    }
+}
+
+#define BENCH_WIDTH(Name, Type, Write, Read)                     \
+    benchWidth<Type>(#Name,                                      \
+        [](Buffer &b, Type v) { b.Write(v); },                   \
+        [](Buffer &b) { return b.Read(); },                      \
+        [](BufferView &b, Type v) { b.Write(v); },               \
+        [](BufferView &b) { return b.Read(); })
+
+static void benchWidths() {
+    BENCH_WIDTH(Int8, char, writeInt8, readInt8);
+    BENCH_WIDTH(UInt8, unsigned char, writeUInt8, readUInt8);
+    BENCH_WIDTH(Int16_LE, short, writeInt16_LE, readInt16_LE);
+    BENCH_WIDTH(Int16_BE, short, writeInt16_BE, readInt16_BE);
+    BENCH_WIDTH(UInt16_LE, unsigned short, writeUInt16_LE, readUInt16_LE);
+    BENCH_WIDTH(UInt16_BE, unsigned short, writeUInt16_BE, readUInt16_BE);
+    BENCH_WIDTH(Int32_LE, int, writeInt32_LE, readInt32_LE);
+    BENCH_WIDTH(Int32_BE, int, writeInt32_BE, readInt32_BE);
+    BENCH_WIDTH(UInt32_LE, unsigned int, writeUInt32_LE, readUInt32_LE);
+    BENCH_WIDTH(UInt32_BE, unsigned int, writeUInt32_BE, readUInt32_BE);
+    BENCH_WIDTH(Int64_LE, long long, writeInt64_LE, readInt64_LE);
+    BENCH_WIDTH(Int64_BE, long long, writeInt64_BE, readInt64_BE);
+    BENCH_WIDTH(UInt64_LE, unsigned long long, writeUInt64_LE, readUInt64_LE);
+    BENCH_WIDTH(UInt64_BE, unsigned long long, writeUInt64_BE, readUInt64_BE);
+    BENCH_WIDTH(Float_LE, float, writeFloat_LE, readFloat_LE);
+    BENCH_WIDTH(Float_BE, float, writeFloat_BE, readFloat_BE);
+    BENCH_WIDTH(Double_LE, double, writeDouble_LE, readDouble_LE);
+    BENCH_WIDTH(Double_BE, double, writeDouble_BE, readDouble_BE);
+}
+
+static void benchByteStr() {
+    Buffer buffer;
+    for (unsigned char i = 0; i < 64; ++i)
+        buffer.writeUInt8(i);
+
+    Bench::run("Buffer/byteStr/64B", buffer.getBuffer().size(), [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            std::string str = buffer.byteStr();
+            Bench::doNotOptimize(str);
+        }
+    });
+}
+
+/************************** Packet encode ***************************/
+
+static SimlyProtocol::RotatorSample makeRotator(size_t i) {
+    SimlyProtocol::RotatorSample sample;
+    sample.type = 1;
+    sample.id = (unsigned short)(i & 0xF);
+    sample.rotation = (int)i;
+    return sample;
+}
+
+static SimlyProtocol::ForceSample makeForce(size_t i) {
+    SimlyProtocol::ForceSample sample;
+    sample.front = (unsigned int)i;
+    sample.back = (unsigned int)i + 1;
+    sample.left = (unsigned int)i + 2;
+    sample.right = (unsigned int)i + 3;
+    return sample;
+}
+
+static void benchEncode() {
+    FixedBuffer<SimlyProtocol::MaxFixedPacketSize> out;
+
+    SimlyProtocol::writePing(out, 0);
+    Bench::run("encode/Ping", out.size(), [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            SimlyProtocol::writePing(out, (int)i);
+            Bench::clobberMemory();
+        }
+    });
+
+    SimlyProtocol::writeRotationRequest(out, makeRotator(0));
+    Bench::run("encode/RotationRequest", out.size(), [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            SimlyProtocol::writeRotationRequest(out, makeRotator(i));
+            Bench::clobberMemory();
+        }
+    });
+
+    // What SendRotationRequest -> SendPacket used to do: two heap Buffers and a body copy
+    Bench::run("encode/RotationRequest/legacy-Buffer", out.size(), [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            SimlyProtocol::RotatorSample request = makeRotator(i);
+            Buffer body;
+            body.writeUInt16_LE(SimlyProtocol::SendRotationRequest);
+            body.writeUInt16_LE(request.type);
+            body.writeUInt16_LE(request.id);
+            body.writeInt32_LE(request.rotation);
+            Buffer packet;
+            packet.writeUInt16_LE((unsigned short)body.getBuffer().size());
+            packet.writeArray(body.getBuffer().data(), (int)body.getBuffer().size());
+            Bench::doNotOptimize(packet);
+        }
+    });
+
+    SimlyProtocol::writePong(out, 0);
+    Bench::run("encode/Pong", out.size(), [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            SimlyProtocol::writePong(out, (int)i);
+            Bench::clobberMemory();
+        }
+    });
+
+    SimlyProtocol::writeForceSensor(out, makeForce(0));
+    Bench::run("encode/ForceSensor", out.size(), [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            SimlyProtocol::writeForceSensor(out, makeForce(i));
+            Bench::clobberMemory();
+        }
+    });
+
+    SimlyProtocol::writeRotator(out, makeRotator(0));
+    Bench::run("encode/Rotator", out.size(), [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            SimlyProtocol::writeRotator(out, makeRotator(i));
+            Bench::clobberMemory();
+        }
+    });
+}
+
+/************************** Packet decode ***************************/
+
+// Builds a stream of ValuesPerRound packets produced by encode(out, index)
+template <class Encode> static std::vector<unsigned char> makeStream(Encode encode) {
+    std::vector<unsigned char> stream;
+    FixedBuffer<SimlyProtocol::MaxFixedPacketSize> out;
+    for (size_t i = 0; i < ValuesPerRound; ++i) {
+        encode(out, i);
+        stream.insert(stream.end(), out.getData(), out.getData() + out.size());
+    }
+    return stream;
+}
+
+// Feeds the stream through a PacketFramer in segment sized reads and decodes every packet
+static void benchDecode(const char *name, const std::vector<unsigned char> &stream) {
+    PacketFramer framer;
+    const size_t bytesPerPacket = stream.size() / ValuesPerRound;
+
+    Bench::run(std::string("decode/") + name, bytesPerPacket, [&](size_t n) {
+        size_t decoded = 0;
+        size_t offset = 0;
+        while (decoded < n) {
+            size_t space = 0;
+            unsigned char *dest = framer.writeSpan(space);
+            size_t chunk = stream.size() - offset;
+            if (chunk > SegmentSize) chunk = SegmentSize;
+            if (chunk > space) chunk = space;
+            memcpy(dest, stream.data() + offset, chunk);
+            framer.commit(chunk);
+            offset = (offset + chunk) % stream.size();
+
+            size_t length = 0;
+            while (const unsigned char *body = framer.nextPacket(length)) {
+                BufferView packet(body, length);
+                switch (packet.readUInt16_LE()) {
+                case SimlyProtocol::RecvPong: {
+                    int code = SimlyProtocol::readPong(packet);
+                    Bench::doNotOptimize(code);
+                    break;
+                }
+                case SimlyProtocol::RecvForceSensor: {
+                    SimlyProtocol::ForceSample sample = SimlyProtocol::readForceSensor(packet);
+                    Bench::doNotOptimize(sample);
+                    break;
+                }
+                case SimlyProtocol::RecvRotator: {
+                    SimlyProtocol::RotatorSample sample = SimlyProtocol::readRotator(packet);
+                    Bench::doNotOptimize(sample);
+                    break;
+                }
+                }
+                framer.consume();
+                ++decoded;
+            }
+        }
+    });
+}
+
+static void benchDecodes() {
+    benchDecode("Pong", makeStream([](BufferView &out, size_t i) {
+        SimlyProtocol::writePong(out, (int)i);
+    }));
+    benchDecode("ForceSensor", makeStream([](BufferView &out, size_t i) {
+        SimlyProtocol::writeForceSensor(out, makeForce(i));
+    }));
+    benchDecode("Rotator", makeStream([](BufferView &out, size_t i) {
+        SimlyProtocol::writeRotator(out, makeRotator(i));
+    }));
+}
+
+/************************** Force batches ***************************/
+
+// Operations are samples here, so the numbers compare directly with encode/decode ForceSensor
+static void benchForceBatch(bool delta) {
+    const std::string suffix = delta ? "/delta" : "/raw";
+
+    // Small steps like a real load cell, every one fits the delta encoding
+    std::vector<SimlyProtocol::ForceBatchSample> samples(SamplesPerBatch);
+    for (size_t i = 0; i < samples.size(); ++i) {
+        samples[i].timestamp = (unsigned int)(i * 1000);
+        samples[i].force = makeForce(i);
+    }
+
+    std::vector<unsigned char> storage(PacketFramer::HeaderSize + SimlyProtocol::forceBatchBodySize(SamplesPerBatch, false));
+    BufferView out(storage.data(), storage.size());
+    SimlyProtocol::writeForceBatch(out, samples.data(), samples.size(), delta);
+    const size_t bytesPerSample = out.size() / SamplesPerBatch;
+
+    Bench::run("encode/ForceBatch" + suffix, bytesPerSample, [&](size_t n) {
+        for (size_t i = 0; i < n; i += SamplesPerBatch) {
+            SimlyProtocol::writeForceBatch(out, samples.data(), samples.size(), delta);
+            Bench::clobberMemory();
+        }
+    });
+
+    std::vector<unsigned char> stream;
+    for (size_t i = 0; i < ValuesPerRound / SamplesPerBatch; ++i) {
+        for (SimlyProtocol::ForceBatchSample &sample : samples)
+            sample.timestamp += (unsigned int)(SamplesPerBatch * 1000);
+        SimlyProtocol::writeForceBatch(out, samples.data(), samples.size(), delta);
+        stream.insert(stream.end(), out.getData(), out.getData() + out.size());
+    }
+
+    // Batches do not line up with segments, the stream position has to carry over between runs
+    // or the framer would be left holding half a packet
+    PacketFramer framer;
+    size_t offset = 0;
+    Bench::run("decode/ForceBatch" + suffix, bytesPerSample, [&](size_t n) {
+        size_t decoded = 0;
+        while (decoded < n) {
+            size_t space = 0;
+            unsigned char *dest = framer.writeSpan(space);
+            size_t chunk = stream.size() - offset;
+            if (chunk > SegmentSize) chunk = SegmentSize;
+            if (chunk > space) chunk = space;
+            memcpy(dest, stream.data() + offset, chunk);
+            framer.commit(chunk);
+            offset = (offset + chunk) % stream.size();
+
+            size_t length = 0;
+            while (const unsigned char *body = framer.nextPacket(length)) {
+                BufferView packet(body, length);
+                if (packet.readUInt16_LE() == SimlyProtocol::RecvForceBatch) {
+                    SimlyProtocol::readForceBatch(packet, [&](const SimlyProtocol::ForceBatchSample &sample) {
+                        Bench::doNotOptimize(sample);
+                        ++decoded;
+                    });
+                }
+                framer.consume();
+            }
+        }
+    });
+}
+
+static void benchForceBatches() {
+    benchForceBatch(false);
+    benchForceBatch(true);
+}
+
+/************************** RVL depth ***************************/
+
+// A 720p RealSense depth frame, the recording resolution the codec was written for
+static const size_t DepthWidth = 1280;
+static const size_t DepthHeight = 720;
+
+static bool checksFailed = false;
+
+static void check(const char *name, bool passed) {
+    printf("%-48s %s\n", name, passed ? "ok" : "FAILED");
+    if (!passed)
+        checksFailed = true;
+}
+
+// Floor, back wall and a box in millimetres with +-2 mm noise, plus the invalid pixels a stereo camera
+// leaves: a band on the left edge and shadows next to the box
+static std::vector<unsigned short> makeDepthFrame(unsigned int seed) {
+    std::vector<unsigned short> depth(DepthWidth * DepthHeight);
+    for (size_t y = 0; y < DepthHeight; ++y) {
+        for (size_t x = 0; x < DepthWidth; ++x) {
+            seed = seed * 1664525u + 1013904223u;
+            const int noise = (int)(seed >> 29) % 5 - 2;
+
+            int value;
+            if (x >= 500 && x < 800 && y >= 300 && y < 600)
+                value = 1200 + (int)(x - 500) / 8;
+            else if (y > DepthHeight / 2)
+                value = 1500 + (int)(DepthHeight - y) * 6;
+            else
+                value = 3000;
+
+            const bool invalid = x < 48 || (x >= 800 && x < 830 && y >= 300 && y < 600);
+            depth[y * DepthWidth + x] = invalid ? 0 : (unsigned short)(value + noise);
+        }
+    }
+    return depth;
+}
+
+static std::vector<unsigned char> encodeDepth(const std::vector<unsigned short> &depth) {
+    std::vector<unsigned char> encoded;
+    RVL::encode(depth.data(), depth.size(), [&](const unsigned char *bytes, size_t length) {
+        encoded.insert(encoded.end(), bytes, bytes + length);
+    });
+    return encoded;
+}
+
+static void checkRVL() {
+    const std::vector<unsigned short> depth = makeDepthFrame(1);
+    const std::vector<unsigned char> encoded = encodeDepth(depth);
+    std::vector<unsigned short> decoded(depth.size());
+
+    check("check/RVL/round-trip", RVL::decode(encoded.data(), encoded.size(), decoded.data(), decoded.size()) && decoded == depth);
+
+    // Every pixel at the extremes of the zigzag delta range and single pixel runs
+    std::vector<unsigned short> extremes(4096);
+    for (size_t i = 0; i < extremes.size(); ++i)
+        extremes[i] = i % 3 == 0 ? 0 : (i % 2 ? 65535 : 1);
+    const std::vector<unsigned char> extremesEncoded = encodeDepth(extremes);
+    std::vector<unsigned short> extremesDecoded(extremes.size());
+    check("check/RVL/round-trip-extremes", RVL::decode(extremesEncoded.data(), extremesEncoded.size(), extremesDecoded.data(), extremesDecoded.size()) && extremesDecoded == extremes);
+
+    const std::vector<unsigned short> empty(depth.size(), 0);
+    const std::vector<unsigned char> emptyEncoded = encodeDepth(empty);
+    check("check/RVL/round-trip-all-invalid", RVL::decode(emptyEncoded.data(), emptyEncoded.size(), decoded.data(), decoded.size()) && decoded == empty);
+
+    // Every shorter prefix has to be refused, not read past
+    bool truncatedRefused = true;
+    for (size_t size = 0; size < encoded.size(); size += size < 256 ? 1 : 4093) {
+        std::vector<unsigned char> truncated(encoded.begin(), encoded.begin() + size);
+        if (RVL::decode(truncated.data(), truncated.size(), decoded.data(), decoded.size()))
+            truncatedRefused = false;
+    }
+    check("check/RVL/truncated", truncatedRefused);
+
+    // A run that ends past the frame, the output buffer is one pixel short
+    check("check/RVL/run-past-frame", !RVL::decode(encoded.data(), encoded.size(), decoded.data(), decoded.size() - 1));
+
+    // Endless continuation nibbles and run lengths past the frame
+    const std::vector<unsigned char> continuation(64, 0xFF);
+    check("check/RVL/endless-value", !RVL::decode(continuation.data(), continuation.size(), decoded.data(), decoded.size()));
+
+    // Random garbage must decode or fail, but never write past the frame (run under ASan to see it)
+    unsigned int seed = 7;
+    std::vector<unsigned char> garbage(4096);
+    for (int round = 0; round < 1000; ++round) {
+        for (unsigned char &byte : garbage) {
+            seed = seed * 1664525u + 1013904223u;
+            byte = (unsigned char)(seed >> 24);
+        }
+        RVL::decode(garbage.data(), garbage.size(), decoded.data(), 4096);
+    }
+    check("check/RVL/garbage", true);
+}
+
+static void benchRVL() {
+    const std::vector<unsigned short> depth = makeDepthFrame(1);
+    const std::vector<unsigned char> encoded = encodeDepth(depth);
+    const size_t rawSize = depth.size() * sizeof(unsigned short);
+    printf("%-48s %10.2fx %12zu bytes/frame (raw %zu)\n", "ratio/RVL/720p", (double)rawSize / encoded.size(), encoded.size(), rawSize);
+
+    // Operations are frames, compare ns/op with the 33 ms frame interval at 30 fps
+    std::vector<unsigned char> out;
+    out.reserve(rawSize);
+    Bench::run("encode/RVL/720p", rawSize, [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            out.clear();
+            RVL::encode(depth.data(), depth.size(), [&](const unsigned char *bytes, size_t length) {
+                out.insert(out.end(), bytes, bytes + length);
+            });
+            Bench::doNotOptimize(out);
+        }
+    });
+
+    std::vector<unsigned short> decoded(depth.size());
+    Bench::run("decode/RVL/720p", rawSize, [&](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            bool ok = RVL::decode(encoded.data(), encoded.size(), decoded.data(), decoded.size());
+            Bench::doNotOptimize(ok);
+            Bench::clobberMemory();
+        }
+    });
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1)
+        Bench::options().filter = argv[1];
+
+    benchWidths();
+    benchByteStr();
+    benchEncode();
+    benchDecodes();
+    benchForceBatches();
+    checkRVL();
+    benchRVL();
+    return checksFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,226 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "BenchmarkHarness.h"
+#include "Buffer.h"
+#include "PacketFramer.h"
+#include "SimlyProtocol.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "NativeSocketOptions.h"
+
+/*
+    Loopback round trip of a rotation request: the server side sends SendRotationRequest and
+    a device thread answers with a Rotator packet. Runs once per socket option set. Options go
+    through NativeSocketOptions::apply, the code SimlySocketOptions::Apply sets FServerSocketOptions
+    with, on the listen socket, the accepted socket and the device socket.
+
+    The device writes the length prefix and the body with separate calls like most firmware
+    does, which is what makes Nagle's algorithm visible.
+*/
+
+// Round trips measured per option set, capped by MaxSecondsPerConfig when Nagle stalls them
+static const size_t RoundTrips = 20000;
+static const size_t WarmupRoundTrips = 200;
+static const double MaxSecondsPerConfig = 2.0;
+
+struct SocketConfig {
+    const char *name;
+    NativeSocketOptions::Settings settings;
+};
+
+static NativeSocketOptions::Settings makeSettings(bool noDelay, int bufferSize, bool keepAlive, int busyPollMicroseconds) {
+    NativeSocketOptions::Settings settings;
+    settings.noDelay = noDelay;
+    settings.receiveBufferSize = bufferSize;
+    settings.sendBufferSize = bufferSize;
+    settings.keepAlive = keepAlive;
+    settings.busyPollMicroseconds = busyPollMicroseconds;
+    return settings;
+}
+
+static const SocketConfig Configs[] = {
+    { "default", makeSettings(false, 0, false, 0) },
+    { "nodelay", makeSettings(true, 0, false, 0) },
+    { "nodelay/buffers-2k", makeSettings(true, 2048, false, 0) },
+    { "nodelay/buffers-256k", makeSettings(true, 256 * 1024, false, 0) },
+    { "nodelay/keepalive", makeSettings(true, 0, true, 0) },
+#if defined(__linux__) && defined(SO_BUSY_POLL)
+    { "nodelay/busy-poll-50us", makeSettings(true, 0, false, 50) },
+#endif
+};
+
+static void applyConfig(int fd, const SocketConfig &config) {
+    NativeSocketOptions::apply(fd, config.settings, [](const char *option, int value) {
+        fprintf(stderr, "%s = %d refused: %s\n", option, value, strerror(errno));
+    });
+}
+
+static bool sendAll(int fd, const unsigned char *data, size_t length) {
+    while (length > 0) {
+        const ssize_t sent = send(fd, data, length, 0);
+        if (sent <= 0)
+            return false;
+        data += sent;
+        length -= (size_t)sent;
+    }
+    return true;
+}
+
+// Blocks until the framer holds a complete packet, returns its body or nullptr on disconnect
+static const unsigned char *receivePacket(int fd, PacketFramer &framer, size_t &length) {
+    for (;;) {
+        if (const unsigned char *body = framer.nextPacket(length))
+            return body;
+        size_t space = 0;
+        unsigned char *dest = framer.writeSpan(space);
+        const ssize_t received = recv(fd, dest, space, 0);
+        if (received <= 0)
+            return nullptr;
+        framer.commit((size_t)received);
+    }
+}
+
+// Answers every rotation request until the server closes the connection
+static void runDevice(int fd) {
+    PacketFramer framer;
+    FixedBuffer<SimlyProtocol::MaxFixedPacketSize> out;
+    size_t length = 0;
+    while (const unsigned char *body = receivePacket(fd, framer, length)) {
+        BufferView packet(body, length);
+        if (packet.readUInt16_LE() == SimlyProtocol::SendRotationRequest) {
+            SimlyProtocol::RotatorSample request;
+            request.type = packet.readUInt16_LE();
+            request.id = packet.readUInt16_LE();
+            request.rotation = packet.readInt32_LE();
+            SimlyProtocol::writeRotator(out, request);
+            if (!sendAll(fd, out.getData(), PacketFramer::HeaderSize) ||
+                !sendAll(fd, out.getData() + PacketFramer::HeaderSize, out.size() - PacketFramer::HeaderSize))
+                break;
+        }
+        framer.consume();
+    }
+    close(fd);
+}
+
+static bool connectPair(const SocketConfig &config, int &server, int &device) {
+    const int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    socklen_t addressLength = sizeof(address);
+
+    // Same order as StartListenServer, buffer sizes before listen
+    applyConfig(listener, config);
+    if (bind(listener, (sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 64) != 0 ||
+        getsockname(listener, (sockaddr *)&address, &addressLength) != 0) {
+        close(listener);
+        return false;
+    }
+
+    device = socket(AF_INET, SOCK_STREAM, 0);
+    applyConfig(device, config);
+    if (connect(device, (sockaddr *)&address, sizeof(address)) != 0) {
+        close(device);
+        close(listener);
+        return false;
+    }
+
+    server = accept(listener, nullptr, nullptr);
+    close(listener);
+    if (server < 0) {
+        close(device);
+        return false;
+    }
+    applyConfig(server, config);
+    return true;
+}
+
+static void benchRoundTrip(const SocketConfig &config) {
+    const std::string name = std::string("rtt/RotationRequest/") + config.name;
+    const Bench::Options &opts = Bench::options();
+    if (opts.filter && name.find(opts.filter) == std::string::npos)
+        return;
+
+    int server = -1;
+    int device = -1;
+    if (!connectPair(config, server, device)) {
+        fprintf(stderr, "%s: unable to open a loopback connection: %s\n", name.c_str(), strerror(errno));
+        return;
+    }
+    std::thread deviceThread(runDevice, device);
+
+    typedef std::chrono::steady_clock Clock;
+    PacketFramer framer;
+    FixedBuffer<SimlyProtocol::MaxFixedPacketSize> out;
+    std::vector<double> samples;
+    samples.reserve(RoundTrips);
+
+    const Clock::time_point deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(MaxSecondsPerConfig));
+    for (size_t i = 0; i < WarmupRoundTrips + RoundTrips; ++i) {
+        SimlyProtocol::RotatorSample request;
+        request.type = 1;
+        request.id = 0;
+        request.rotation = (int)i;
+
+        const Clock::time_point start = Clock::now();
+        SimlyProtocol::writeRotationRequest(out, request);
+        size_t length = 0;
+        if (!sendAll(server, out.getData(), out.size()) || !receivePacket(server, framer, length))
+            break;
+        framer.consume();
+        const Clock::time_point end = Clock::now();
+
+        if (i >= WarmupRoundTrips)
+            samples.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+        if (end > deadline && samples.size() >= 100)
+            break;
+    }
+
+    shutdown(server, SHUT_RDWR);
+    close(server);
+    deviceThread.join();
+
+    if (samples.empty()) {
+        fprintf(stderr, "%s: no round trips completed\n", name.c_str());
+        return;
+    }
+
+    double total = 0;
+    for (double sample : samples)
+        total += sample;
+    std::sort(samples.begin(), samples.end());
+    const double p50 = samples[(samples.size() - 1) / 2];
+    const double p99 = samples[(size_t)((samples.size() - 1) * 0.99)];
+    printf("%-48s %8.1f us p50 %8.1f us p99 %8.1f us mean %7zu trips\n", name.c_str(), p50, p99, total / samples.size(), samples.size());
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1)
+        Bench::options().filter = argv[1];
+
+    for (const SocketConfig &config : Configs)
+        benchRoundTrip(config);
+    return EXIT_SUCCESS;
+}
@@ -16,6 +16,9 @@ Buffer::Buffer(const std::vector<unsigned char> &_buffer) noexcept:
 void Buffer::setBuffer(std::vector<unsigned char> &_buffer) noexcept {
     buffer = _buffer;
 }
+void Buffer::setBuffer(std::vector<unsigned char> &&_buffer) noexcept {
+    buffer = std::move(_buffer);
+}
 const std::vector<unsigned char> &Buffer::getBuffer() const noexcept {
     return buffer;
 }
@@ -42,27 +45,19 @@ std::string Buffer::byteStr(bool LE) const noexcept {
 }
 
 template <class T> inline void Buffer::writeBytes(const T &val, bool LE) {
-    unsigned int size = sizeof(T);
-
-    if (LE == true) {
-        for (unsigned int i = 0, mask = 0; i < size; ++i, mask += 8)
-            buffer.push_back(val >> mask);
-    } else {
-        unsigned const char *array = reinterpret_cast<unsigned const char*>(&val);
-        for (unsigned int i = 0; i < size; ++i)
-            buffer.push_back(array[size - i - 1]);
-    }
-    writeOffset += size;
+    const size_t offset = buffer.size();
+    buffer.resize(offset + sizeof(T));
+    BufferDetail::store<T>(&buffer[offset], val, LE);
+    writeOffset += sizeof(T);
 }
 
 unsigned long long Buffer::getWriteOffset() const noexcept {
     return writeOffset;
 }
 
-void Buffer::writeArray(unsigned char* data, int size) noexcept {
-    std::vector<unsigned char> append(data, data + size);
-    buffer.insert(std::end(buffer), std::begin(append), std::end(append));
-    //for (int i = 0; i < size; ++i) writeBytes<char>(data[i]);
+void Buffer::writeArray(const unsigned char* data, int size) noexcept {
+    buffer.insert(std::end(buffer), data, data + size);
+    writeOffset += size;
 }
 void Buffer::writeBool(bool val) noexcept {
     writeBytes<bool>(val);
@@ -140,35 +135,23 @@ void Buffer::writeDouble_BE(double val) noexcept {
 /************************* READING *************************/
 
 void Buffer::setReadOffset(unsigned long long newOffset) noexcept {
-    readOffset = newOffset;
+    readOffset = newOffset < buffer.size() ? newOffset : buffer.size();
 }
 unsigned long long Buffer::getReadOffset() const noexcept {
     return readOffset;
 }
 template <class T> inline T Buffer::readBytes(bool LE) {
-    T result = 0;
-    unsigned int size = sizeof(T);
-
     // Do not overflow
-    if (readOffset + size > buffer.size())
-        return result;
-
-    char *dst = (char*)&result;
-    char *src = (char*)&buffer[readOffset];
+    if (readOffset + sizeof(T) > buffer.size())
+        return T();
 
-    if (LE == true) {
-        for (unsigned int i = 0; i < size; ++i)
-            dst[i] = src[i];
-    } else {
-        for (unsigned int i = 0; i < size; ++i)
-            dst[i] = src[size - i - 1];
-    }
-    readOffset += size;
+    T result = BufferDetail::load<T>(&buffer[readOffset], LE);
+    readOffset += sizeof(T);
     return result;
 }
 
 bool Buffer::readBool() noexcept {
-    return readBytes<bool>();
+    return readBytes<unsigned char>() != 0;
 }
 std::string Buffer::readStr(unsigned long long len) noexcept {
     if (readOffset + len > buffer.size())
@@ -9,103 +9,158 @@
 #include "ClientSocket.h"
 #include "ServerSocket.h"
 
-void ClientSocket::ProcessPacket(UServerSocket* server)
+bool ClientSocket::ReceiveData(UServerSocket* server)
 {
-	short nPacketID = this->RecvBuff.readUInt16_LE();
-	UE_LOG(LogTemp, Log, TEXT("[ClientSocket] Processing Packet: %d."), nPacketID);
+	bool bConnected = true;
+	while (bConnected && !this->bWantsClose)
+	{
+		// Take everything the kernel has, as far as it fits in the ring
+		size_t Space = 0;
+		unsigned char* Dest = this->RecvFramer.writeSpan(Space);
+
+		int32 Read = 0;
+		bConnected = this->Socket->Recv(Dest, (int32) Space, Read);
+		this->RecvFramer.commit(Read);
+		this->LastReceiveCycles = FPlatformTime::Cycles64();
+
+		// Handle every complete packet, partial ones stay in the ring until the rest arrives
+		size_t Length = 0;
+		while (const unsigned char* Body = this->RecvFramer.nextPacket(Length))
+		{
+			BufferView Packet(Body, Length);
+			ProcessPacket(server, Packet);
+			this->RecvFramer.consume();
+		}
+
+		// A short read means the socket is drained, a full one means there may be more behind the wrap point
+		if ((size_t) Read < Space)
+		{
+			break;
+		}
+	}
+
+	return bConnected && !this->bWantsClose;
+}
+
+void ClientSocket::ProcessPacket(UServerSocket* server, BufferView& Packet)
+{
+	short nPacketID = Packet.readUInt16_LE();
+	UE_LOG(LogTemp, Verbose, TEXT("[ClientSocket] Processing Packet: %d."), nPacketID);
 	switch (nPacketID)
 	{
-	case 0xF0:
+	case SimlyProtocol::RecvHandshake:
 		// HandleHandshake();
 		break;
-	case 0x01:
-		HandlePong(this->RecvBuff.readInt32_LE());
+	case SimlyProtocol::RecvPong:
+		HandlePong(SimlyProtocol::readPong(Packet));
+		break;
+	case SimlyProtocol::RecvForceSensor:
+		HandleForceSensor(server, Packet);
 		break;
-	case 0x02:
-		HandleForceSensor(server);
+	case SimlyProtocol::RecvRotator:
+		HandleRotator(server, Packet);
 		break;
-	case 0x03:
-		HandleRotator(server);
+	case SimlyProtocol::RecvForceBatch:
+		HandleForceBatch(server, Packet);
 		break;
 	}
 }
 
-void ClientSocket::HandleForceSensor(UServerSocket* server)
+void ClientSocket::HandleForceSensor(UServerSocket* server, BufferView& Packet)
 {
 	// Create struct with sensor data
-	this->Force.front = this->RecvBuff.readUInt32_LE();
-	this->Force.back = this->RecvBuff.readUInt32_LE();
-	this->Force.left = this->RecvBuff.readUInt32_LE();
-	this->Force.right = this->RecvBuff.readUInt32_LE();
+	const SimlyProtocol::ForceSample Sample = SimlyProtocol::readForceSensor(Packet);
+	this->Force.front = Sample.front;
+	this->Force.back = Sample.back;
+	this->Force.left = Sample.left;
+	this->Force.right = Sample.right;
+	this->Force.timestamp = 0;
 
-	// Broadcast result on server object
-	AsyncTask(ENamedThreads::GameThread, [server, this]()
+	// Broadcast on the server's next tick
+	server->QueueSensorEvent(*this, false);
+}
+
+void ClientSocket::HandleForceBatch(UServerSocket* server, BufferView& Packet)
+{
+	// Decoded by the server, straight into the sensor history
+	if (!server->QueueForceBatch(*this, Packet))
 	{
-		server->OnForceSensorData.Broadcast(this->Address, this->Force);
-	});
+		UE_LOG(LogTemp, Warning, TEXT("[ClientSocket] Malformed force batch from %s."), *this->Address);
+	}
 }
 
-void ClientSocket::HandleRotator(UServerSocket* server)
+void ClientSocket::HandleRotator(UServerSocket* server, BufferView& Packet)
 {
 	// Create struct with sensor data
-	this->Rotation.type = this->RecvBuff.readUInt16_LE();
-	this->Rotation.id = this->RecvBuff.readUInt16_LE();
-	this->Rotation.rotation = this->RecvBuff.readInt32_LE();
+	const SimlyProtocol::RotatorSample Sample = SimlyProtocol::readRotator(Packet);
+	this->Rotation.type = Sample.type;
+	this->Rotation.id = Sample.id;
+	this->Rotation.rotation = Sample.rotation;
 
-	// Broadcast result on server object
-	AsyncTask(ENamedThreads::GameThread, [server, this]()
-	{
-		server->OnRotationData.Broadcast(this->Address, this->Rotation);
-	});
+	// Broadcast on the server's next tick
+	server->QueueSensorEvent(*this, true);
 }
 
-void ClientSocket::SendPacket(Buffer OutPacket)
+bool ClientSocket::SendPacket(const BufferView& OutPacket)
 {
-	if (OutPacket.getBuffer().empty())
+	if (OutPacket.size() <= PacketFramer::HeaderSize || !OutPacket.good())
 	{
 		UE_LOG(LogTemp, Error, TEXT("[ClientSocket] OutPacket buffer was empty."));
-		return;
+		return false;
+	}
+
+	if (this->Socket == nullptr || this->bWantsClose)
+	{
+		return false;
 	}
 
-	// Make Packet
-	Buffer Packet;
-	Packet.writeUInt16_LE(OutPacket.getBuffer().size());
-	Packet.writeArray((unsigned char*) OutPacket.getBuffer().data(), OutPacket.getBuffer().size());
+	// Queue Packet, the server thread coalesces everything queued into one write
+	bool bWasEmpty = false;
+	if (!this->SendQueue.Enqueue(OutPacket.getData(), OutPacket.size(), bWasEmpty))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[ClientSocket] Send backlog full for %s, dropped packet (%d dropped so far)."), *this->Address, this->SendQueue.GetDroppedPackets());
+		return false;
+	}
 
-	// Send Packet
-	int32 BytesSent = 0;
-	bool success = this->Socket->Send(Packet.getBuffer().data(), Packet.getBuffer().size(), BytesSent);
+	return bWasEmpty;
+}
 
-	// Release buffer(s)
-	Packet.clear();
-	OutPacket.clear();
+bool ClientSocket::FlushSend()
+{
+	if (this->Socket == nullptr)
+	{
+		return false;
+	}
 
-	if (!success)
+	const int32 Queued = this->SendQueue.Num();
+	if (!this->SendQueue.Flush(this->Socket))
 	{
 		UE_LOG(LogTemp, Error, TEXT("[ClientSocket] Unable to send OutPacket!"));
-		this->Socket->Close();
-		return;
+		this->bWantsClose = true;
+		return false;
 	}
 
-	UE_LOG(LogTemp, Log, TEXT("[ClientSocket] Succesfully sent packet of %d Bytes."), (int) BytesSent);
+	UE_LOG(LogTemp, Verbose, TEXT("[ClientSocket] Flushed %d of %d queued Bytes."), Queued - this->SendQueue.Num(), Queued);
+	return true;
 }
 
-void ClientSocket::SendPing()
+bool ClientSocket::SendPing()
 {
-	Buffer OutPacket;
-	OutPacket.writeUInt16_LE(0x01);
-	OutPacket.writeInt32_LE(this->PingNum ^ this->PingKey);
-	this->SendPacket(OutPacket);
+	FixedBuffer<SimlyProtocol::MaxFixedPacketSize> OutPacket;
+	SimlyProtocol::writePing(OutPacket, this->PingNum ^ this->PingKey);
+	return this->SendPacket(OutPacket);
 }
 
-void ClientSocket::SendRotationRequest(FRotatorSensor request)
+bool ClientSocket::SendRotationRequest(FRotatorSensor request)
 {
-	Buffer OutPacket;
-	OutPacket.writeUInt16_LE(0x02);
-	OutPacket.writeUInt16_LE(request.type);
-	OutPacket.writeUInt16_LE(request.id);
-	OutPacket.writeInt32_LE(request.rotation);
-	this->SendPacket(OutPacket);
+	SimlyProtocol::RotatorSample Sample;
+	Sample.type = request.type;
+	Sample.id = request.id;
+	Sample.rotation = request.rotation;
+
+	FixedBuffer<SimlyProtocol::MaxFixedPacketSize> OutPacket;
+	SimlyProtocol::writeRotationRequest(OutPacket, Sample);
+	return this->SendPacket(OutPacket);
 }
 
 void ClientSocket::HandlePong(uint32 code)
@@ -116,5 +171,5 @@ void ClientSocket::HandlePong(uint32 code)
 		UE_LOG(LogTemp, Log, TEXT("[ClientSocket] Validated Pong."));
 		this->PingNum = -1;
 	}
-	else this->Socket->Close();
+	else this->bWantsClose = true;
 }
\ No newline at end of file
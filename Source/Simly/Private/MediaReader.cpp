@@ -8,6 +8,12 @@
 
 #include "MediaReader.h"
 
+// Longest the reader thread sleeps before checking for a seek, pause or stop
+#define IDLE_WAIT_MS 10
+
+// Sleep overshoots by up to a scheduler tick, the last stretch before a frame is due only yields
+#define SPIN_WAIT_MS 2
+
 AMediaReader::AMediaReader(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer)
 {
 	PrimaryActorTick.bCanEverTick = true;
@@ -16,19 +22,7 @@ AMediaReader::AMediaReader(const FObjectInitializer& ObjectInitializer) : Super(
 
 AMediaReader::~AMediaReader()
 {
-	StartedFlag = false;
-	if (Thread.Get())
-	{
-		{
-			Thread->WaitForCompletion();
-		}
-		Thread.Reset();
-	}
-	Worker.Reset();
-	if (this->FileHandle)
-	{
-		delete FileHandle;
-	}
+	StopPlayback();
 }
 
 void AMediaReader::BeginPlay()
@@ -39,6 +33,8 @@ void AMediaReader::BeginPlay()
 
 void AMediaReader::Initialize(FString FileName)
 {
+	StopPlayback();
+
 	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
 	if (!PlatformFile.FileExists(*FileName))
 	{
@@ -46,123 +42,280 @@ void AMediaReader::Initialize(FString FileName)
 		return;
 	}
 
-	this->FileHandle = PlatformFile.OpenRead(*FileName);
-	if (this->FileHandle)
+	if (Video.Open(FileName))
 	{
-		// Get File Header
-		uint8 head[12];
-		this->FileHandle->Read(head, 12);
-		const FILEHEADER* header = (const FILEHEADER*)head;
+		if (!FPointCloudVideoCodec::IsDepthCodec(Video.GetDepthCodec()) || !FPointCloudVideoCodec::IsColorCodec(Video.GetColorCodec()))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("[Point Cloud Video] Unsupported codec in %s."), *FileName);
+			Video.Close();
+			return;
+		}
 
 		// Set frame variables
-		this->Width = header->width;
-		this->Height = header->height;
-		this->DEPTH_BUFFER = new uint8[sizeof(uint16) * Width * Height];
-		this->COLOR_BUFFER = new uint8[sizeof(uint32) * Width * Height];
+		this->Width = Video.GetWidth();
+		this->Height = Video.GetHeight();
 
-		// Initialize point-cloud
-		for (int i = 0; i < Width * Height; ++i)
-			this->Points.Add(FLidarPointCloudPoint(0, 0, -1000 * i, 0, 0, 0));
+		// Initialize point-cloud, the bounds grow with the first frames
+		// A frame of the previous video may still be published
+		if (Frames.IsDirty()) Frames.SwapReadBuffers();
+		Points.Reset();
+		PointsBounds = FBox(ForceInit);
+		CloudBounds = FBox(ForceInit);
+		DensePoints.Reset();
+		DenseVersion = 0;
+		Converter.ResetTiles();
+		FPointCloudConverter::Upload(PointCloud, Points, LidarPoints, PointsBounds, CloudBounds);
 
-		this->PointCloud->SetData(Points);
+		if (!Prefetcher.Open(&Video, PrefetchFrames))
+		{
+			Video.Close();
+			return;
+		}
+		Prefetcher.SetLoop(bLoop);
 
 		// Initialize worker thread
+		Clock.Reset(0.0);
+		Clock.SetRate(PlaybackRate);
+		Clock.Resume();
+		bSeekPending = false;
+		NextFrame = 0;
+		CurrentFrame = 0;
+
 		StartedFlag = true;
 		Worker.Reset(new FMediaReaderWorker(this));
-		StartTime = (uint64)FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64());
 		FString ThreadName(FString::Printf(TEXT("FRealSenseInspectorWorker_%s"), *FGuid::NewGuid().ToString()));
 		Thread.Reset(FRunnableThread::Create(Worker.Get(), *ThreadName, 0, TPri_Normal));
 		if (!Thread.Get())UE_LOG(LogTemp, Fatal, TEXT("Unable to create thread"));
 
-		UE_LOG(LogTemp, Log, TEXT("[Point Cloud Video] Got header, resolution: %d : %d"), header->width, header->height);
+		UE_LOG(LogTemp, Log, TEXT("[Point Cloud Video] Opened v%u, resolution: %d : %d, %d frames"), Video.GetVersion(), Width, Height, Video.NumFrames());
+	}
+}
+
+void AMediaReader::StopPlayback()
+{
+	StartedFlag = false;
+	if (Thread.Get())
+	{
+		{
+			Thread->WaitForCompletion();
+		}
+		Thread.Reset();
 	}
+	Worker.Reset();
+	Prefetcher.Close();
+	Video.Close();
 }
 
 void AMediaReader::ThreadProc()
 {
-	if (this->FileHandle)
+	bool bEndOfFile = false;
+
+	while (StartedFlag)
 	{
-		while (StartedFlag)
+		int32 Frame = INDEX_NONE;
+		double WaitMs = IDLE_WAIT_MS;
+		bool bScheduled = false;
+		bool bSeek = false;
+		Prefetcher.SetLoop(bLoop);
 		{
-			uint64 PassedTime = (uint64) FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64()) - StartTime;
+			FScopeLock Lock(&PlaybackMx);
+
+			if (NextFrame >= Video.NumFrames() && bLoop && Video.NumFrames() > 0)
+			{
+				// Restart with the first frame due right away
+				NextFrame = 0;
+				Clock.Seek(Video.GetTimestamp(0));
+			}
 
-			// Check if the file has another frame header
-			if (FileHandle->Size() - FileHandle->Tell() < sizeof(uint64))
+			if (NextFrame >= Video.NumFrames())
+			{
+				if (!bEndOfFile) UE_LOG(LogTemp, Warning, TEXT("[Point Cloud Video] End of file."));
+				bEndOfFile = true;
+			}
+			else if (bSeekPending)
 			{
-				UE_LOG(LogTemp, Warning, TEXT("[Point Cloud Video] End of file."));
-				StartedFlag = false;
-				delete FileHandle;
-				return;
+				Frame = NextFrame;
+				bSeek = true;
 			}
-			
-			// Get Timestamp
-			uint8 head[sizeof(uint64)];
-			FileHandle->Read(head, sizeof(uint64));
-			
-			uint64 timestamp = ((uint64)head[7] << 56)
-				| ((uint64)head[6] << 48)
-				| ((uint64)head[5] << 40)
-				| ((uint64)head[4] << 32)
-				| ((uint64)head[3] << 24)
-				| ((uint64)head[2] << 16)
-				| ((uint64)head[1] << 8)
-				| ((uint64)head[0]);				
-
-			// Check if ready for next frame
-			if (PassedTime >= timestamp)
+			else if (!Clock.IsPaused())
 			{
-				// Get color & depth data
-				UE_LOG(LogTemp, Warning, TEXT("[Point Cloud Video] Updating PCL: pt%d, ts:%d"), PassedTime, timestamp);
-				FileHandle->Read(DEPTH_BUFFER, this->Width * this->Height * sizeof(uint16));
-				FileHandle->Read(COLOR_BUFFER, this->Width * this->Height * sizeof(RGBA));
-				UpdatePointCloud();
+				const double UntilDue = Clock.GetSecondsUntil(Video.GetTimestamp(NextFrame)) * 1000.0;
+				if (UntilDue <= 0.0)
+				{
+					// Skip straight to the newest due frame when running behind
+					Frame = FMath::Max(NextFrame, Video.FindFrame((uint64)Clock.GetMediaTime()));
+					Clock.AddDropped(Frame - NextFrame);
+					bScheduled = true;
+				}
+				else WaitMs = FMath::Min(UntilDue, WaitMs);
 			}
-			else
+
+			if (Frame != INDEX_NONE)
 			{
-				// Move reader back to be able to read timestamp again.
-				FileHandle->Seek(FileHandle->Tell() - sizeof(uint64));
+				CurrentFrame = Frame;
+				NextFrame = Frame + 1;
+				bSeekPending = false;
+				bEndOfFile = false;
 			}
 		}
+
+		if (Frame == INDEX_NONE)
+		{
+			if (WaitMs > SPIN_WAIT_MS) FPlatformProcess::Sleep((float)((WaitMs - SPIN_WAIT_MS) / 1000.0));
+			else FPlatformProcess::Sleep(0.0f);
+			continue;
+		}
+
+		// Blocks until the prefetcher has the frame, a slow disk shows up as lateness and later frames are skipped
+		if (bSeek) Prefetcher.Seek(Frame);
+		int32 Slot = INDEX_NONE;
+		while (StartedFlag && (Slot = Prefetcher.Acquire(Frame, IDLE_WAIT_MS)) == INDEX_NONE) {}
+		if (Slot == INDEX_NONE) break;
+
+		// Frames without changes are not published, so Tick has nothing to upload
+		if (ConvertFrame(Prefetcher.GetSlot(Slot), Frames.GetWriteBuffer())) Frames.SwapWriteBuffers();
+		Prefetcher.Release(Slot);
+
+		if (bScheduled)
+		{
+			// Measured once the frame is published, a seek in the meantime moved the clock so it doesn't count
+			FScopeLock Lock(&PlaybackMx);
+			if (!bSeekPending && !Clock.IsPaused()) Clock.AddPresented(Video.GetTimestamp(Frame));
+		}
 	}
 }
 
+void AMediaReader::Pause()
+{
+	FScopeLock Lock(&PlaybackMx);
+	Clock.Pause();
+}
+
+void AMediaReader::Resume()
+{
+	FScopeLock Lock(&PlaybackMx);
+	Clock.Resume();
+}
+
+void AMediaReader::SeekToTime(float Seconds)
+{
+	FScopeLock Lock(&PlaybackMx);
+	const uint64 Target = (uint64)(FMath::Max(Seconds, 0.0f) * 1000.0);
+
+	NextFrame = Video.FindFrame(Target);
+	bSeekPending = true;
+	Clock.Seek(Target);
+}
+
+void AMediaReader::SetPlaybackRate(float Rate)
+{
+	FScopeLock Lock(&PlaybackMx);
+	Clock.SetRate(Rate);
+	PlaybackRate = Clock.GetRate();
+}
+
+bool AMediaReader::IsPaused() const
+{
+	FScopeLock Lock(&PlaybackMx);
+	return Clock.IsPaused();
+}
+
+float AMediaReader::GetPlaybackTime() const
+{
+	FScopeLock Lock(&PlaybackMx);
+	return (float)(Clock.GetMediaTime() / 1000.0);
+}
+
+float AMediaReader::GetDuration() const
+{
+	return Video.GetDuration() / 1000.0f;
+}
+
+FMediaPlaybackStats AMediaReader::GetPlaybackStats() const
+{
+	FScopeLock Lock(&PlaybackMx);
+	FMediaPlaybackStats Stats;
+	Stats.PresentedFrames = Clock.GetNumPresented();
+	Stats.DroppedFrames = Clock.GetNumDropped();
+	Stats.MeanLatenessMs = (float)Clock.GetMeanLateness();
+	Stats.MaxLatenessMs = (float)Clock.GetMaxLateness();
+	Stats.JitterMs = (float)Clock.GetJitter();
+	return Stats;
+}
+
+void AMediaReader::ResetPlaybackStats()
+{
+	FScopeLock Lock(&PlaybackMx);
+	Clock.ResetStats();
+}
+
+TArray<FLidarPointCloudPoint> AMediaReader::GetPoints() const
+{
+	TArray<FLidarPointCloudPoint> Result;
+	Points.ToLidarPoints(Result);
+	return Result;
+}
+
+int32 AMediaReader::GetNumPoints() const
+{
+	return Points.Num();
+}
+
 void AMediaReader::Tick(float DeltaSeconds)
 {
 	Super::Tick(DeltaSeconds);
+	if (!Frames.IsDirty()) return;
+
+	// Take the newest frame and hand the previous point buffer back to the reader thread
+	Frames.SwapReadBuffers();
+	Exchange(Points, Frames.Read().Points);
+	PointsBounds = Frames.Read().Bounds;
+	FPointCloudConverter::Upload(PointCloud, Points, LidarPoints, PointsBounds, CloudBounds);
 }
 
-void AMediaReader::UpdatePointCloud()
+FDepthConversionParams AMediaReader::GetConversionParams() const
 {
-	const int centerx = 0.5 * Width;
-	const int centery = 0.5 * Height;
+	FDepthConversionParams Params;
+	Params.Width = Width;
+	Params.Height = Height;
+	Params.DepthScale = DepthScale;
+	Params.ScaleX = ScaleX;
+	Params.ScaleY = ScaleY;
+	Params.DepthMin = DepthMin;
+	Params.DepthMax = DepthMax;
+	Params.NumWorkers = ConversionWorkers;
+	Params.DirtyDepthThreshold = DirtyDepthThreshold;
+	Params.DirtyColorThreshold = DirtyColorThreshold;
+	Params.Decimation = Decimation;
+	Params.DecimationFactor = DecimationFactor;
+	Params.PointBudget = PointBudget;
+	return Params;
+}
 
-	const uint16_t* depth_data = (const uint16_t*)DEPTH_BUFFER;
-	const RGBA* color_data = (const RGBA*)COLOR_BUFFER;
-	
-	for (int i = 0; i < Width * Height; ++i)
-	{
-		const uint16_t depth = depth_data[i];
-		const RGBA color = color_data[i];
+void AMediaReader::UpdatePointCloud()
+{
+	// Presented again by the reader thread, like a seek to the frame that is already showing
+	FScopeLock Lock(&PlaybackMx);
+	NextFrame = CurrentFrame;
+	bSeekPending = true;
+}
 
-		float z = depth * DepthScale;
-		float x = ((i % Width) - centerx - 0.5f) * z * ScaleX;
-		float y = ((i / Width) - centery - 0.5f) * z * ScaleY;
+bool AMediaReader::ConvertFrame(const FPrefetchedFrame& Frame, FMediaReaderFrame& OutFrame)
+{
+	if (!Frame.bValid) return false;
 
-		if (z < this->DepthMin || z > this->DepthMax)
-		{
-			this->Points[i].Location.Set(0, 0, 0);
-			this->Points[i].Color.R = 0;
-			this->Points[i].Color.G = 0;
-			this->Points[i].Color.B = 0;
-		}
-		else
-		{
-			this->Points[i].Location.Set(-x, -z, -y);
-			this->Points[i].Color.R = color.r;
-			this->Points[i].Color.G = color.g;
-			this->Points[i].Color.B = color.b;
-		}
+	const uint16* Depth = Frame.Depth.GetData();
+	const uint32* Color = Frame.Color.GetData();
+	const FDepthConversionParams Params = Converter.Decimate(GetConversionParams(), Depth, Color);
+	if (!bIncrementalUpdate)
+	{
+		Converter.ConvertCompact(Params, Depth, Color, OutFrame.Points, OutFrame.Bounds);
+		return true;
 	}
 
-	PointCloud->SetData(Points);
-}
\ No newline at end of file
+	// Nothing moved, the uploaded cloud is still current
+	if (!Converter.ConvertIncremental(Params, Depth, Color, DensePoints, DenseVersion)) return false;
+
+	Converter.Compact(Params, DensePoints, OutFrame.Points, OutFrame.Bounds);
+	return true;
+}
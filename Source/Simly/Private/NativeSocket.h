@@ -0,0 +1,43 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Sockets.h"
+
+/*
+	The only way into the OS handle behind an FSocket. FSocketBSD lives in an engine private
+	header, Simly.Build.cs adds its directory and sets SIMLY_NATIVE_SOCKETS only when the engine
+	ships it. Everything that uses it keeps a path through the portable FSocket API for when it
+	doesn't, FSocketPoller::GetBackendName tells which one a build took.
+*/
+#ifndef SIMLY_NATIVE_SOCKETS
+#define SIMLY_NATIVE_SOCKETS 0
+#endif
+
+#if SIMLY_NATIVE_SOCKETS && !PLATFORM_HAS_BSD_SOCKETS
+#undef SIMLY_NATIVE_SOCKETS
+#define SIMLY_NATIVE_SOCKETS 0
+#endif
+
+#if SIMLY_NATIVE_SOCKETS
+
+#if PLATFORM_WINDOWS
+typedef UPTRINT FNativeSocketHandle;
+#else
+typedef int FNativeSocketHandle;
+#endif
+
+namespace SimlyNativeSocket
+{
+	FNativeSocketHandle Get(FSocket* Socket);
+}
+
+#endif
@@ -0,0 +1,90 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+/*
+    setsockopt half of SimlySocketOptions::Apply. Engine independent, so the socket latency
+    benchmark runs the exact code the server applies its FServerSocketOptions with.
+
+    Include it after the platform socket headers: winsock2.h and mstcpip.h on Windows,
+    sys/socket.h, netinet/in.h and netinet/tcp.h everywhere else.
+*/
+
+namespace NativeSocketOptions {
+    struct Settings {
+        bool noDelay = true;
+        int receiveBufferSize = 0; // 0 keeps the OS default
+        int sendBufferSize = 0;    // 0 keeps the OS default
+        bool keepAlive = false;
+        int keepAliveIdleSeconds = 10;
+        int keepAliveIntervalSeconds = 2;
+        int keepAliveProbes = 3;     // not configurable on Windows
+        int busyPollMicroseconds = 0; // Linux only, 0 is off
+    };
+
+    template <class Handle, class OnRefused>
+    bool setOption(Handle socket, int level, int name, int value, const char *label, OnRefused &onRefused) {
+        if (setsockopt(socket, level, name, (const char *)&value, sizeof(value)) == 0)
+            return true;
+        onRefused(label, value);
+        return false;
+    }
+
+    /*
+        Applies every setting to an OS socket handle. onRefused(const char *option, int value) is
+        called right after a refused option, while errno/WSAGetLastError still describe it. Returns
+        false when anything was refused, the remaining options are still applied.
+    */
+    template <class Handle, class OnRefused>
+    bool apply(Handle socket, const Settings &settings, OnRefused &&onRefused) {
+        bool applied = setOption(socket, IPPROTO_TCP, TCP_NODELAY, settings.noDelay ? 1 : 0, "TCP_NODELAY", onRefused);
+
+        // The OS may round or cap the sizes, only a refusal counts as failure
+        if (settings.receiveBufferSize > 0)
+            applied &= setOption(socket, SOL_SOCKET, SO_RCVBUF, settings.receiveBufferSize, "SO_RCVBUF", onRefused);
+        if (settings.sendBufferSize > 0)
+            applied &= setOption(socket, SOL_SOCKET, SO_SNDBUF, settings.sendBufferSize, "SO_SNDBUF", onRefused);
+
+        if (!settings.keepAlive) {
+            applied &= setOption(socket, SOL_SOCKET, SO_KEEPALIVE, 0, "SO_KEEPALIVE", onRefused);
+        } else {
+#if defined(_WIN32)
+            // Enables keepalive and sets both timings in one call, the probe count is fixed by the OS
+            tcp_keepalive values;
+            values.onoff = 1;
+            values.keepalivetime = (unsigned long)settings.keepAliveIdleSeconds * 1000;
+            values.keepaliveinterval = (unsigned long)settings.keepAliveIntervalSeconds * 1000;
+            unsigned long returned = 0;
+            if (WSAIoctl(socket, SIO_KEEPALIVE_VALS, &values, sizeof(values), nullptr, 0, &returned, nullptr, nullptr) != 0) {
+                onRefused("SIO_KEEPALIVE_VALS", 1);
+                applied = false;
+            }
+#else
+            applied &= setOption(socket, SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE", onRefused);
+#if defined(TCP_KEEPIDLE)
+            applied &= setOption(socket, IPPROTO_TCP, TCP_KEEPIDLE, settings.keepAliveIdleSeconds, "TCP_KEEPIDLE", onRefused);
+#elif defined(TCP_KEEPALIVE)
+            applied &= setOption(socket, IPPROTO_TCP, TCP_KEEPALIVE, settings.keepAliveIdleSeconds, "TCP_KEEPALIVE", onRefused);
+#endif
+#if defined(TCP_KEEPINTVL)
+            applied &= setOption(socket, IPPROTO_TCP, TCP_KEEPINTVL, settings.keepAliveIntervalSeconds, "TCP_KEEPINTVL", onRefused);
+#endif
+#if defined(TCP_KEEPCNT)
+            applied &= setOption(socket, IPPROTO_TCP, TCP_KEEPCNT, settings.keepAliveProbes, "TCP_KEEPCNT", onRefused);
+#endif
+#endif
+        }
+
+#if defined(__linux__) && defined(SO_BUSY_POLL)
+        if (settings.busyPollMicroseconds > 0)
+            applied &= setOption(socket, SOL_SOCKET, SO_BUSY_POLL, settings.busyPollMicroseconds, "SO_BUSY_POLL", onRefused);
+#endif
+        return applied;
+    }
+}
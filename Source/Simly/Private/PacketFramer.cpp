@@ -0,0 +1,71 @@
+#include "PacketFramer.h"
+#include <cstring> // memcpy
+
+PacketFramer::PacketFramer(size_t _capacity) noexcept {
+    // Has to fit at least one packet of the maximum size or the stream stalls
+    size_t size = 1;
+    while (size < _capacity || size < HeaderSize + MaxPacketSize)
+        size <<= 1;
+
+    ring.resize(size);
+    scratch.resize(MaxPacketSize);
+    mask = size - 1;
+}
+
+unsigned char *PacketFramer::writeSpan(size_t &length) noexcept {
+    const size_t start = tail & mask;
+    const size_t untilWrap = ring.size() - start;
+    const size_t free = freeSpace();
+    length = free < untilWrap ? free : untilWrap;
+    return &ring[start];
+}
+
+void PacketFramer::commit(size_t length) noexcept {
+    tail += length;
+}
+
+const unsigned char *PacketFramer::nextPacket(size_t &length) noexcept {
+    length = 0;
+    if (pending != 0 || size() < HeaderSize)
+        return nullptr;
+
+    const size_t bodyLength = ring[head & mask] | (ring[(head + 1) & mask] << 8);
+    if (size() < HeaderSize + bodyLength)
+        return nullptr;
+
+    pending = HeaderSize + bodyLength;
+    length = bodyLength;
+
+    const size_t start = (head + HeaderSize) & mask;
+    if (start + bodyLength <= ring.size())
+        return &ring[start];
+
+    // Packet wraps around, hand out a contiguous copy instead
+    const size_t first = ring.size() - start;
+    memcpy(scratch.data(), &ring[start], first);
+    memcpy(scratch.data() + first, &ring[0], bodyLength - first);
+    return scratch.data();
+}
+
+void PacketFramer::consume() noexcept {
+    head += pending;
+    pending = 0;
+}
+
+size_t PacketFramer::size() const noexcept {
+    return tail - head;
+}
+
+size_t PacketFramer::freeSpace() const noexcept {
+    return ring.size() - size();
+}
+
+size_t PacketFramer::capacity() const noexcept {
+    return ring.size();
+}
+
+void PacketFramer::clear() noexcept {
+    head = 0;
+    tail = 0;
+    pending = 0;
+}
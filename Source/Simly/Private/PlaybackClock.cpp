@@ -0,0 +1,94 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "PlaybackClock.h"
+
+#define MIN_PLAYBACK_RATE 0.25f
+#define MAX_PLAYBACK_RATE 8.0f
+
+void FPlaybackClock::Reset(double MediaTime)
+{
+	AnchorSeconds = FPlatformTime::Seconds();
+	AnchorMediaTime = MediaTime;
+	bPaused = true;
+	ResetStats();
+}
+
+void FPlaybackClock::Pause()
+{
+	if (bPaused) return;
+
+	AnchorMediaTime = GetMediaTime();
+	bPaused = true;
+}
+
+void FPlaybackClock::Resume()
+{
+	if (!bPaused) return;
+
+	AnchorSeconds = FPlatformTime::Seconds();
+	bPaused = false;
+}
+
+void FPlaybackClock::Seek(double MediaTime)
+{
+	AnchorSeconds = FPlatformTime::Seconds();
+	AnchorMediaTime = MediaTime;
+}
+
+void FPlaybackClock::SetRate(float InRate)
+{
+	// Re-anchor first so the time played so far keeps the old rate
+	Seek(GetMediaTime());
+	Rate = FMath::Clamp(InRate, MIN_PLAYBACK_RATE, MAX_PLAYBACK_RATE);
+}
+
+double FPlaybackClock::GetMediaTime() const
+{
+	if (bPaused) return AnchorMediaTime;
+	return AnchorMediaTime + (FPlatformTime::Seconds() - AnchorSeconds) * 1000.0 * Rate;
+}
+
+double FPlaybackClock::GetSecondsUntil(double MediaTime) const
+{
+	if (bPaused) return 0.0;
+	return FMath::Max((MediaTime - GetMediaTime()) / (1000.0 * Rate), 0.0);
+}
+
+void FPlaybackClock::AddPresented(double DueTime)
+{
+	// Lateness in wall clock ms, a frame 10 media ms late at 2x was only shown 5 ms late
+	const double Lateness = (GetMediaTime() - DueTime) / Rate;
+
+	// Welford's running mean and variance
+	NumPresented++;
+	const double Delta = Lateness - LatenessMean;
+	LatenessMean += Delta / NumPresented;
+	LatenessM2 += Delta * (Lateness - LatenessMean);
+	LatenessMax = FMath::Max(LatenessMax, Lateness);
+}
+
+void FPlaybackClock::AddDropped(int32 NumFrames)
+{
+	NumDropped += NumFrames;
+}
+
+void FPlaybackClock::ResetStats()
+{
+	NumPresented = 0;
+	NumDropped = 0;
+	LatenessMean = 0.0;
+	LatenessM2 = 0.0;
+	LatenessMax = 0.0;
+}
+
+double FPlaybackClock::GetJitter() const
+{
+	return NumPresented > 1 ? FMath::Sqrt(LatenessM2 / (NumPresented - 1)) : 0.0;
+}
@@ -0,0 +1,78 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "PointCloudBuffer.h"
+#include "Async/ParallelFor.h"
+
+void FPointCloudBuffer::SetNum(int32 Num, bool bWithMask)
+{
+	X.SetNumUninitialized(Num, false);
+	Y.SetNumUninitialized(Num, false);
+	Z.SetNumUninitialized(Num, false);
+	Colors.SetNumUninitialized(Num, false);
+
+	if (bWithMask) Valid.SetNumUninitialized(Num, false);
+	else Valid.Reset();
+}
+
+void FPointCloudBuffer::Reset()
+{
+	X.Reset();
+	Y.Reset();
+	Z.Reset();
+	Colors.Reset();
+	Valid.Reset();
+}
+
+int32 FPointCloudBuffer::NumValid() const
+{
+	if (Valid.Num() == 0) return Num();
+
+	int32 Count = 0;
+	for (const uint8 Flag : Valid) Count += Flag;
+	return Count;
+}
+
+template <typename TransformType>
+static void ConvertToLidar(const FPointCloudBuffer& Points, TArray<FLidarPointCloudPoint>& OutPoints, TransformType Transform)
+{
+	// Existing elements keep their other fields, only location and color are written
+	OutPoints.SetNum(Points.NumValid(), false);
+
+	if (Points.Valid.Num() == 0)
+	{
+		ParallelFor(Points.Num(), [&](int32 Index)
+		{
+			FLidarPointCloudPoint& Point = OutPoints[Index];
+			Point.Location = Transform(Points.GetLocation(Index));
+			Point.Color.DWColor() = Points.Colors[Index];
+		});
+		return;
+	}
+
+	int32 Cursor = 0;
+	for (int32 Index = 0; Index < Points.Num(); ++Index)
+	{
+		if (!Points.Valid[Index]) continue;
+
+		FLidarPointCloudPoint& Point = OutPoints[Cursor++];
+		Point.Location = Transform(Points.GetLocation(Index));
+		Point.Color.DWColor() = Points.Colors[Index];
+	}
+}
+
+void FPointCloudBuffer::ToLidarPoints(TArray<FLidarPointCloudPoint>& OutPoints) const
+{
+	ConvertToLidar(*this, OutPoints, [](const FVector& Location) { return Location; });
+}
+
+void FPointCloudBuffer::ToLidarPoints(TArray<FLidarPointCloudPoint>& OutPoints, const FTransform& Transform) const
+{
+	ConvertToLidar(*this, OutPoints, [&Transform](const FVector& Location) { return Transform.TransformPosition(Location); });
+}
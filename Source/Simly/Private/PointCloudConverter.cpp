@@ -0,0 +1,765 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "PointCloudConverter.h"
+#include "LidarPointCloud.h"
+#include "Async/ParallelFor.h"
+#include "HAL/ThreadSafeCounter.h"
+
+#if SIMLY_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+// Opaque black, what out of range pixels used to be written as
+#define INVALID_COLOR 0xFF000000u
+
+// Below this a band costs more to schedule than to convert
+#define MIN_ROWS_PER_BAND 16
+
+// Incremental conversion granularity, in pixels
+#define TILE_SIZE 32
+
+// Largest decimation block, 8 x 8 pixels
+#define MAX_DECIMATION 8
+
+// Minimum room left around the points when the cloud bounds have to grow
+#define CLOUD_BOUNDS_MARGIN 100.0f
+
+// RGBA8 in memory (R lowest byte) to FColor's BGRA layout, alpha forced to opaque
+static FORCEINLINE uint32 RGBAToBGRA(uint32 Color)
+{
+	return (Color & 0x0000FF00u) | ((Color & 0x000000FFu) << 16) | ((Color >> 16) & 0x000000FFu) | 0xFF000000u;
+}
+
+static FORCEINLINE void WritePoint(FPointCloudBuffer& Points, int32 Index, float X, float Y, float Z, uint32 Color)
+{
+	Points.X[Index] = X;
+	Points.Y[Index] = Y;
+	Points.Z[Index] = Z;
+	Points.Colors[Index] = Color;
+}
+
+void FPointCloudConverter::Convert(const FDepthConversionParams& InParams, const uint16* Depth, const uint32* Color, FPointCloudBuffer& Points)
+{
+	const FDepthConversionParams Params = UpdateRays(InParams);
+	const int32 NumPoints = Params.Width * Params.Height;
+	if (Points.Num() != NumPoints || Points.Valid.Num() != NumPoints)
+	{
+		Points.SetNum(NumPoints, true);
+	}
+
+	// Every row belongs to exactly one band, so the result doesn't depend on scheduling
+	const int32 NumBands = GetNumBands(Params);
+	ParallelFor(NumBands, [&](int32 Band)
+	{
+		const int32 RowBegin = (int64)Params.Height * Band / NumBands;
+		const int32 RowEnd = (int64)Params.Height * (Band + 1) / NumBands;
+		ConvertRows(Params, Depth, Color, Points, RowBegin, RowEnd);
+	}, NumBands == 1);
+}
+
+int32 FPointCloudConverter::GetNumBands(const FDepthConversionParams& Params)
+{
+	const int32 Workers = Params.NumWorkers > 0 ? Params.NumWorkers : FTaskGraphInterface::Get().GetNumWorkerThreads() + 1;
+	const int32 MaxBands = FMath::Max(1, Params.Height / MIN_ROWS_PER_BAND);
+	return FMath::Clamp(Workers, 1, MaxBands);
+}
+
+int32 FPointCloudConverter::GetDecimationFactor(const FDepthConversionParams& Params)
+{
+	switch (Params.Decimation)
+	{
+	case EDepthDecimation::Subsample:
+	case EDepthDecimation::Median:
+		return FMath::Clamp(Params.DecimationFactor, 1, MAX_DECIMATION);
+
+	case EDepthDecimation::PointBudget:
+		if (Params.PointBudget <= 0) return 1;
+		for (int32 Factor = 1; Factor < MAX_DECIMATION; ++Factor)
+		{
+			if ((int64)(Params.Width / Factor) * (Params.Height / Factor) <= Params.PointBudget) return Factor;
+		}
+		return MAX_DECIMATION;
+
+	default:
+		return 1;
+	}
+}
+
+// Center offset that makes the ray of output pixel i go through input pixel i * Factor + Sample
+static float DecimatedCenterOffset(int32 Size, int32 OutSize, float Offset, int32 Factor, float Sample)
+{
+	const float Center = (int32)(0.5 * Size) + Offset;
+	return (Center + 0.5f - Sample) / Factor - (int32)(0.5 * OutSize) - 0.5f;
+}
+
+// Median of the valid depths of a block, with the color of the pixel it came from. Blocks without depth stay 0
+static void MedianOfBlock(const uint16* Depth, const uint32* Color, int32 Stride, int32 Factor, uint16& OutDepth, uint32& OutColor)
+{
+	uint16 Values[MAX_DECIMATION * MAX_DECIMATION];
+	uint32 Colors[MAX_DECIMATION * MAX_DECIMATION];
+	int32 Num = 0;
+
+	// Insertion sort while gathering, blocks are at most 64 pixels
+	for (int32 Y = 0; Y < Factor; ++Y)
+	{
+		for (int32 X = 0; X < Factor; ++X)
+		{
+			const uint16 Value = Depth[Y * Stride + X];
+			if (Value == 0) continue;
+
+			int32 Slot = Num++;
+			for (; Slot > 0 && Values[Slot - 1] > Value; --Slot)
+			{
+				Values[Slot] = Values[Slot - 1];
+				Colors[Slot] = Colors[Slot - 1];
+			}
+			Values[Slot] = Value;
+			Colors[Slot] = Color[Y * Stride + X];
+		}
+	}
+
+	if (Num == 0)
+	{
+		OutDepth = 0;
+		OutColor = Color[0];
+		return;
+	}
+
+	OutDepth = Values[(Num - 1) / 2];
+	OutColor = Colors[(Num - 1) / 2];
+}
+
+FDepthConversionParams FPointCloudConverter::Decimate(const FDepthConversionParams& Params, const uint16*& Depth, const uint32*& Color)
+{
+	const int32 Factor = GetDecimationFactor(Params);
+	if (Factor <= 1 || Params.Width < Factor || Params.Height < Factor) return Params;
+
+	// Partial blocks at the right and bottom edge are dropped
+	FDepthConversionParams Out = Params;
+	Out.Width = Params.Width / Factor;
+	Out.Height = Params.Height / Factor;
+	Out.ScaleX = Params.ScaleX * Factor;
+	Out.ScaleY = Params.ScaleY * Factor;
+	Out.Decimation = EDepthDecimation::None;
+
+	// Subsample takes the pixel nearest the block center, the median stands for the whole block
+	const bool bMedian = Params.Decimation != EDepthDecimation::Subsample;
+	const int32 SampleIndex = (Factor - 1) / 2;
+	const float Sample = bMedian ? 0.5f * (Factor - 1) : SampleIndex;
+	Out.CenterOffsetX = DecimatedCenterOffset(Params.Width, Out.Width, Params.CenterOffsetX, Factor, Sample);
+	Out.CenterOffsetY = DecimatedCenterOffset(Params.Height, Out.Height, Params.CenterOffsetY, Factor, Sample);
+	Out.PixelStep = Params.PixelStep * Factor;
+	Out.PixelOffsetX = Params.PixelOffsetX + Params.PixelStep * Sample;
+	Out.PixelOffsetY = Params.PixelOffsetY + Params.PixelStep * Sample;
+	Out.RayTableX = nullptr;
+	Out.RayTableY = nullptr;
+
+	DecimatedDepth.SetNumUninitialized(Out.Width * Out.Height, false);
+	DecimatedColor.SetNumUninitialized(Out.Width * Out.Height, false);
+
+	const int32 NumBands = GetNumBands(Out);
+	uint16* OutDepth = DecimatedDepth.GetData();
+	uint32* OutColor = DecimatedColor.GetData();
+	const uint16* InDepth = Depth;
+	const uint32* InColor = Color;
+
+	ParallelFor(NumBands, [&](int32 Band)
+	{
+		const int32 RowBegin = (int64)Out.Height * Band / NumBands;
+		const int32 RowEnd = (int64)Out.Height * (Band + 1) / NumBands;
+
+		for (int32 Row = RowBegin; Row < RowEnd; ++Row)
+		{
+			for (int32 Col = 0; Col < Out.Width; ++Col)
+			{
+				const int32 Index = Row * Out.Width + Col;
+				const int32 Block = Row * Factor * Params.Width + Col * Factor;
+
+				if (bMedian)
+				{
+					MedianOfBlock(InDepth + Block, InColor + Block, Params.Width, Factor, OutDepth[Index], OutColor[Index]);
+				}
+				else
+				{
+					const int32 Source = Block + SampleIndex * Params.Width + SampleIndex;
+					OutDepth[Index] = InDepth[Source];
+					OutColor[Index] = InColor[Source];
+				}
+			}
+		}
+	}, NumBands == 1);
+
+	Depth = OutDepth;
+	Color = OutColor;
+	return Out;
+}
+
+/**
+* Shared conversion kernel. Dense writes every pixel of the rectangle to its row major slot and clears Valid
+* for invalid pixels. Compact writes only valid pixels, back to back from index Offset, and grows Bounds.
+* Returns the number of points written.
+*/
+template <bool bCompact>
+static int32 ConvertKernel(const FDepthConversionParams& Params, const uint16* Depth, const uint32* Color, FPointCloudBuffer& Points, int32 Offset, int32 RowBegin, int32 RowEnd, int32 ColBegin, int32 ColEnd, FBox* Bounds)
+{
+	const int32 Width = Params.Width;
+	const float CenterX = (int32)(0.5 * Params.Width) + Params.CenterOffsetX;
+	const float CenterY = (int32)(0.5 * Params.Height) + Params.CenterOffsetY;
+
+	// Output is (-x, -z, -y), fold the negation into the per axis factors
+	const float DepthMin = Params.bClipDepth ? Params.DepthMin : -MAX_flt;
+	const float DepthMax = Params.bClipDepth ? Params.DepthMax : MAX_flt;
+
+	int32 Cursor = Offset;
+	FVector BoundsMin(MAX_flt), BoundsMax(-MAX_flt);
+
+#if SIMLY_SIMD_SSE2
+	const __m128 VInf = _mm_set1_ps(MAX_flt);
+	const __m128 VNegInf = _mm_set1_ps(-MAX_flt);
+	__m128 VMinX = VInf, VMinY = VInf, VMinZ = VInf;
+	__m128 VMaxX = VNegInf, VMaxY = VNegInf, VMaxZ = VNegInf;
+#endif
+
+	for (int32 Row = RowBegin; Row < RowEnd; ++Row)
+	{
+		const uint16* DepthRow = Depth + Row * Width;
+		const uint32* ColorRow = Color + Row * Width;
+		const int32 RowOffset = Row * Width;
+		float* XRow = Points.X.GetData() + RowOffset;
+		float* YRow = Points.Y.GetData() + RowOffset;
+		float* ZRow = Points.Z.GetData() + RowOffset;
+		uint32* PointColorRow = Points.Colors.GetData() + RowOffset;
+		uint8* ValidRow = bCompact ? nullptr : Points.Valid.GetData() + RowOffset;
+		const float* RayXRow = Params.RayTableX ? Params.RayTableX + Row * Width : nullptr;
+		const float* RayYRow = Params.RayTableY ? Params.RayTableY + Row * Width : nullptr;
+
+		// y only depends on the row, x on the column
+		const float NegRayY = -(Row - CenterY - 0.5f) * Params.ScaleY;
+		const float NegRayXStart = -(0 - CenterX - 0.5f) * Params.ScaleX;
+		const float NegRayXStep = -Params.ScaleX;
+
+		int32 Col = ColBegin;
+
+#if SIMLY_SIMD_SSE2
+		const __m128 VDepthScale = _mm_set1_ps(Params.DepthScale);
+		const __m128 VDepthMin = _mm_set1_ps(DepthMin);
+		const __m128 VDepthMax = _mm_set1_ps(DepthMax);
+		const __m128 VNegRayY = _mm_set1_ps(NegRayY);
+		const __m128 VRayXStep = _mm_set1_ps(4 * NegRayXStep);
+		const __m128i VZero = _mm_setzero_si128();
+		const __m128i VGreen = _mm_set1_epi32(0x0000FF00);
+		const __m128i VLowByte = _mm_set1_epi32(0x000000FF);
+		const __m128i VAlpha = _mm_set1_epi32((int32)INVALID_COLOR);
+
+		__m128 VNegRayX = _mm_add_ps(_mm_set1_ps(NegRayXStart + Col * NegRayXStep), _mm_mul_ps(_mm_setr_ps(0, 1, 2, 3), _mm_set1_ps(NegRayXStep)));
+
+		alignas(16) float X[4], Y[4], Z[4];
+		alignas(16) uint32 C[4];
+
+		for (; Col + 4 <= ColEnd; Col += 4)
+		{
+			// 4 x uint16 depth -> 4 x float
+			const __m128i VDepth16 = _mm_loadl_epi64((const __m128i*)(DepthRow + Col));
+			const __m128 VDepth = _mm_cvtepi32_ps(_mm_unpacklo_epi16(VDepth16, VZero));
+
+			// Range test as a mask instead of a branch, 0 is "no data"
+			const __m128 VZ = _mm_mul_ps(VDepth, VDepthScale);
+			const __m128 VValid = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(VZ, VDepthMin), _mm_cmple_ps(VZ, VDepthMax)), _mm_cmpgt_ps(VDepth, _mm_setzero_ps()));
+			const int32 ValidMask = _mm_movemask_ps(VValid);
+
+			// Nothing to write for an all invalid group when compacting
+			if (bCompact && ValidMask == 0)
+			{
+				VNegRayX = _mm_add_ps(VNegRayX, VRayXStep);
+				continue;
+			}
+
+			// One multiply per axis with a ray table, otherwise x steps along the row and y is constant
+			const __m128 VRayX = RayXRow ? _mm_loadu_ps(RayXRow + Col) : VNegRayX;
+			const __m128 VRayY = RayYRow ? _mm_loadu_ps(RayYRow + Col) : VNegRayY;
+
+			const __m128 VNegZ = _mm_sub_ps(_mm_setzero_ps(), VZ);
+			const __m128 VX = _mm_and_ps(VValid, _mm_mul_ps(VRayX, VZ));
+			const __m128 VY = _mm_and_ps(VValid, VNegZ);
+			const __m128 VZOut = _mm_and_ps(VValid, _mm_mul_ps(VRayY, VZ));
+
+			// RGBA -> BGRA, invalid pixels become opaque black
+			const __m128i VColor = _mm_loadu_si128((const __m128i*)(ColorRow + Col));
+			__m128i VBGRA = _mm_or_si128(_mm_and_si128(VColor, VGreen), _mm_slli_epi32(_mm_and_si128(VColor, VLowByte), 16));
+			VBGRA = _mm_or_si128(VBGRA, _mm_and_si128(_mm_srli_epi32(VColor, 16), VLowByte));
+			VBGRA = _mm_or_si128(_mm_and_si128(_mm_castps_si128(VValid), VBGRA), VAlpha);
+
+			if (bCompact)
+			{
+				_mm_store_ps(X, VX);
+				_mm_store_ps(Y, VY);
+				_mm_store_ps(Z, VZOut);
+				_mm_store_si128((__m128i*)C, VBGRA);
+
+				// Invalid lanes must not pull the bounds towards the origin
+				VMinX = _mm_min_ps(VMinX, _mm_or_ps(VX, _mm_andnot_ps(VValid, VInf)));
+				VMinY = _mm_min_ps(VMinY, _mm_or_ps(VY, _mm_andnot_ps(VValid, VInf)));
+				VMinZ = _mm_min_ps(VMinZ, _mm_or_ps(VZOut, _mm_andnot_ps(VValid, VInf)));
+				VMaxX = _mm_max_ps(VMaxX, _mm_or_ps(VX, _mm_andnot_ps(VValid, VNegInf)));
+				VMaxY = _mm_max_ps(VMaxY, _mm_or_ps(VY, _mm_andnot_ps(VValid, VNegInf)));
+				VMaxZ = _mm_max_ps(VMaxZ, _mm_or_ps(VZOut, _mm_andnot_ps(VValid, VNegInf)));
+
+				for (int32 Lane = 0; Lane < 4; ++Lane)
+				{
+					if (ValidMask & (1 << Lane)) WritePoint(Points, Cursor++, X[Lane], Y[Lane], Z[Lane], C[Lane]);
+				}
+			}
+			else
+			{
+				// Straight register stores, one byte of the mask per pixel
+				_mm_storeu_ps(XRow + Col, VX);
+				_mm_storeu_ps(YRow + Col, VY);
+				_mm_storeu_ps(ZRow + Col, VZOut);
+				_mm_storeu_si128((__m128i*)(PointColorRow + Col), VBGRA);
+
+				const uint32 ValidBytes = (ValidMask & 1) | ((ValidMask & 2) << 7) | ((ValidMask & 4) << 14) | ((ValidMask & 8) << 21);
+				FMemory::Memcpy(ValidRow + Col, &ValidBytes, sizeof(ValidBytes));
+			}
+
+			VNegRayX = _mm_add_ps(VNegRayX, VRayXStep);
+		}
+#endif
+
+		// Scalar tail (and fallback)
+		for (; Col < ColEnd; ++Col)
+		{
+			const float Z = DepthRow[Col] * Params.DepthScale;
+			if (DepthRow[Col] == 0 || Z < DepthMin || Z > DepthMax)
+			{
+				if (!bCompact)
+				{
+					XRow[Col] = YRow[Col] = ZRow[Col] = 0;
+					PointColorRow[Col] = INVALID_COLOR;
+					ValidRow[Col] = 0;
+				}
+				continue;
+			}
+
+			const float RayX = RayXRow ? RayXRow[Col] : NegRayXStart + Col * NegRayXStep;
+			const float RayY = RayYRow ? RayYRow[Col] : NegRayY;
+			const FVector Location(RayX * Z, -Z, RayY * Z);
+
+			if (bCompact)
+			{
+				WritePoint(Points, Cursor++, Location.X, Location.Y, Location.Z, RGBAToBGRA(ColorRow[Col]));
+				BoundsMin = BoundsMin.ComponentMin(Location);
+				BoundsMax = BoundsMax.ComponentMax(Location);
+			}
+			else
+			{
+				XRow[Col] = Location.X;
+				YRow[Col] = Location.Y;
+				ZRow[Col] = Location.Z;
+				PointColorRow[Col] = RGBAToBGRA(ColorRow[Col]);
+				ValidRow[Col] = 1;
+			}
+		}
+	}
+
+	if (!bCompact) return (RowEnd - RowBegin) * (ColEnd - ColBegin);
+
+#if SIMLY_SIMD_SSE2
+	alignas(16) float Min[3][4], Max[3][4];
+	_mm_store_ps(Min[0], VMinX);
+	_mm_store_ps(Min[1], VMinY);
+	_mm_store_ps(Min[2], VMinZ);
+	_mm_store_ps(Max[0], VMaxX);
+	_mm_store_ps(Max[1], VMaxY);
+	_mm_store_ps(Max[2], VMaxZ);
+	for (int32 Lane = 0; Lane < 4; ++Lane)
+	{
+		BoundsMin = BoundsMin.ComponentMin(FVector(Min[0][Lane], Min[1][Lane], Min[2][Lane]));
+		BoundsMax = BoundsMax.ComponentMax(FVector(Max[0][Lane], Max[1][Lane], Max[2][Lane]));
+	}
+#endif
+
+	const int32 Written = Cursor - Offset;
+	if (Written > 0) *Bounds += FBox(BoundsMin, BoundsMax);
+	return Written;
+}
+
+void FPointCloudConverter::ConvertRows(const FDepthConversionParams& Params, const uint16* Depth, const uint32* Color, FPointCloudBuffer& Points, int32 RowBegin, int32 RowEnd)
+{
+	ConvertKernel<false>(Params, Depth, Color, Points, 0, RowBegin, RowEnd, 0, Params.Width, nullptr);
+}
+
+void FPointCloudConverter::ConvertRect(const FDepthConversionParams& Params, const uint16* Depth, const uint32* Color, FPointCloudBuffer& Points, int32 RowBegin, int32 RowEnd, int32 ColBegin, int32 ColEnd)
+{
+	ConvertKernel<false>(Params, Depth, Color, Points, 0, RowBegin, RowEnd, ColBegin, ColEnd, nullptr);
+}
+
+int32 FPointCloudConverter::ConvertRowsCompact(const FDepthConversionParams& Params, const uint16* Depth, const uint32* Color, FPointCloudBuffer& Points, int32 Offset, int32 RowBegin, int32 RowEnd, FBox& Bounds)
+{
+	return ConvertKernel<true>(Params, Depth, Color, Points, Offset, RowBegin, RowEnd, 0, Params.Width, &Bounds);
+}
+
+int32 FPointCloudConverter::CountValid(const FDepthConversionParams& Params, const uint16* Depth, int32 RowBegin, int32 RowEnd)
+{
+	// Same test as the kernel, on the raw values
+	const float DepthMin = Params.bClipDepth ? Params.DepthMin : -MAX_flt;
+	const float DepthMax = Params.bClipDepth ? Params.DepthMax : MAX_flt;
+	const uint16* Begin = Depth + RowBegin * Params.Width;
+	const int32 Num = (RowEnd - RowBegin) * Params.Width;
+
+	int32 Count = 0;
+	int32 Index = 0;
+
+#if SIMLY_SIMD_SSE2
+	const __m128 VDepthScale = _mm_set1_ps(Params.DepthScale);
+	const __m128 VDepthMin = _mm_set1_ps(DepthMin);
+	const __m128 VDepthMax = _mm_set1_ps(DepthMax);
+	const __m128i VZero = _mm_setzero_si128();
+	__m128i VCount = _mm_setzero_si128();
+
+	for (; Index + 4 <= Num; Index += 4)
+	{
+		const __m128 VDepth = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(Begin + Index)), VZero));
+		const __m128 VZ = _mm_mul_ps(VDepth, VDepthScale);
+		const __m128 VValid = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(VZ, VDepthMin), _mm_cmple_ps(VZ, VDepthMax)), _mm_cmpgt_ps(VDepth, _mm_setzero_ps()));
+
+		// Valid lanes are all ones, i.e. -1
+		VCount = _mm_sub_epi32(VCount, _mm_castps_si128(VValid));
+	}
+
+	alignas(16) int32 Lanes[4];
+	_mm_store_si128((__m128i*)Lanes, VCount);
+	Count = Lanes[0] + Lanes[1] + Lanes[2] + Lanes[3];
+#endif
+
+	for (; Index < Num; ++Index)
+	{
+		const float Z = Begin[Index] * Params.DepthScale;
+		if (Begin[Index] != 0 && Z >= DepthMin && Z <= DepthMax) ++Count;
+	}
+
+	return Count;
+}
+
+void FPointCloudConverter::ConvertCompact(const FDepthConversionParams& InParams, const uint16* Depth, const uint32* Color, FPointCloudBuffer& Points, FBox& OutBounds)
+{
+	const FDepthConversionParams Params = UpdateRays(InParams);
+	// Count per band, then every band converts straight into its own slice of the output
+	const int32 NumBands = GetNumBands(Params);
+	BandOffsets.SetNumUninitialized(NumBands + 1, false);
+	BandBounds.Init(FBox(ForceInit), NumBands);
+
+	ParallelFor(NumBands, [&](int32 Band)
+	{
+		const int32 RowBegin = (int64)Params.Height * Band / NumBands;
+		const int32 RowEnd = (int64)Params.Height * (Band + 1) / NumBands;
+		BandOffsets[Band + 1] = CountValid(Params, Depth, RowBegin, RowEnd);
+	}, NumBands == 1);
+
+	BandOffsets[0] = 0;
+	for (int32 Band = 0; Band < NumBands; ++Band) BandOffsets[Band + 1] += BandOffsets[Band];
+	Points.SetNum(BandOffsets[NumBands], false);
+
+	ParallelFor(NumBands, [&](int32 Band)
+	{
+		const int32 RowBegin = (int64)Params.Height * Band / NumBands;
+		const int32 RowEnd = (int64)Params.Height * (Band + 1) / NumBands;
+		ConvertRowsCompact(Params, Depth, Color, Points, BandOffsets[Band], RowBegin, RowEnd, BandBounds[Band]);
+	}, NumBands == 1);
+
+	OutBounds = FBox(ForceInit);
+	for (const FBox& Bounds : BandBounds) OutBounds += Bounds;
+}
+
+void FPointCloudConverter::Compact(const FDepthConversionParams& Params, const FPointCloudBuffer& Dense, FPointCloudBuffer& Points, FBox& OutBounds)
+{
+	const int32 NumBands = GetNumBands(Params);
+	BandOffsets.SetNumUninitialized(NumBands + 1, false);
+	BandBounds.Init(FBox(ForceInit), NumBands);
+
+	const int32 NumPoints = Dense.Num();
+
+	ParallelFor(NumBands, [&](int32 Band)
+	{
+		const int32 Begin = (int64)NumPoints * Band / NumBands;
+		const int32 End = (int64)NumPoints * (Band + 1) / NumBands;
+
+		int32 Count = 0;
+		for (int32 Index = Begin; Index < End; ++Index) Count += Dense.IsValid(Index);
+		BandOffsets[Band + 1] = Count;
+	}, NumBands == 1);
+
+	BandOffsets[0] = 0;
+	for (int32 Band = 0; Band < NumBands; ++Band) BandOffsets[Band + 1] += BandOffsets[Band];
+	Points.SetNum(BandOffsets[NumBands], false);
+
+	ParallelFor(NumBands, [&](int32 Band)
+	{
+		const int32 Begin = (int64)NumPoints * Band / NumBands;
+		const int32 End = (int64)NumPoints * (Band + 1) / NumBands;
+
+		int32 Cursor = BandOffsets[Band];
+		for (int32 Index = Begin; Index < End; ++Index)
+		{
+			if (!Dense.IsValid(Index)) continue;
+			WritePoint(Points, Cursor++, Dense.X[Index], Dense.Y[Index], Dense.Z[Index], Dense.Colors[Index]);
+			BandBounds[Band] += Dense.GetLocation(Index);
+		}
+	}, NumBands == 1);
+
+	OutBounds = FBox(ForceInit);
+	for (const FBox& Bounds : BandBounds) OutBounds += Bounds;
+}
+
+// True when any pixel of the tile moved beyond the thresholds
+static bool TileChanged(const FDepthConversionParams& Params, const uint16* Depth, const uint32* Color, const uint16* RefDepth, const uint32* RefColor, int32 RowBegin, int32 RowEnd, int32 ColBegin, int32 ColEnd)
+{
+	const int32 Cols = ColEnd - ColBegin;
+
+	for (int32 Row = RowBegin; Row < RowEnd; ++Row)
+	{
+		const int32 Offset = Row * Params.Width + ColBegin;
+		const uint16* DepthRow = Depth + Offset;
+		const uint16* RefDepthRow = RefDepth + Offset;
+		const uint32* ColorRow = Color + Offset;
+		const uint32* RefColorRow = RefColor + Offset;
+
+		if (Params.DirtyDepthThreshold <= 0 && Params.DirtyColorThreshold <= 0)
+		{
+			if (FMemory::Memcmp(DepthRow, RefDepthRow, Cols * sizeof(uint16)) != 0) return true;
+			if (FMemory::Memcmp(ColorRow, RefColorRow, Cols * sizeof(uint32)) != 0) return true;
+			continue;
+		}
+
+		int32 Col = 0;
+
+#if SIMLY_SIMD_SSE2
+		// |a - b| per lane from two saturating subtracts, anything left after subtracting the threshold is a change
+		const __m128i VDepthThreshold = _mm_set1_epi16((int16)FMath::Clamp(Params.DirtyDepthThreshold, 0, 0xFFFF));
+		const __m128i VColorThreshold = _mm_set1_epi8((int8)FMath::Clamp(Params.DirtyColorThreshold, 0, 0xFF));
+		const __m128i VZero = _mm_setzero_si128();
+
+		for (; Col + 8 <= Cols; Col += 8)
+		{
+			const __m128i VDepth = _mm_loadu_si128((const __m128i*)(DepthRow + Col));
+			const __m128i VRefDepth = _mm_loadu_si128((const __m128i*)(RefDepthRow + Col));
+			const __m128i VDepthDiff = _mm_or_si128(_mm_subs_epu16(VDepth, VRefDepth), _mm_subs_epu16(VRefDepth, VDepth));
+			__m128i VChanged = _mm_subs_epu16(VDepthDiff, VDepthThreshold);
+
+			for (int32 Half = 0; Half < 8; Half += 4)
+			{
+				const __m128i VColor = _mm_loadu_si128((const __m128i*)(ColorRow + Col + Half));
+				const __m128i VRefColor = _mm_loadu_si128((const __m128i*)(RefColorRow + Col + Half));
+				const __m128i VColorDiff = _mm_or_si128(_mm_subs_epu8(VColor, VRefColor), _mm_subs_epu8(VRefColor, VColor));
+				VChanged = _mm_or_si128(VChanged, _mm_subs_epu8(VColorDiff, VColorThreshold));
+			}
+
+			if (_mm_movemask_epi8(_mm_cmpeq_epi8(VChanged, VZero)) != 0xFFFF) return true;
+		}
+#endif
+
+		for (; Col < Cols; ++Col)
+		{
+			if (FMath::Abs((int32)DepthRow[Col] - (int32)RefDepthRow[Col]) > Params.DirtyDepthThreshold) return true;
+
+			const uint32 A = ColorRow[Col];
+			const uint32 B = RefColorRow[Col];
+			for (int32 Shift = 0; Shift < 32; Shift += 8)
+			{
+				if (FMath::Abs((int32)((A >> Shift) & 0xFF) - (int32)((B >> Shift) & 0xFF)) > Params.DirtyColorThreshold) return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+static bool SameConversion(const FDepthConversionParams& A, const FDepthConversionParams& B)
+{
+	return A.Width == B.Width && A.Height == B.Height
+		&& A.DepthScale == B.DepthScale && A.ScaleX == B.ScaleX && A.ScaleY == B.ScaleY
+		&& A.DepthMin == B.DepthMin && A.DepthMax == B.DepthMax && A.bClipDepth == B.bClipDepth
+		&& A.CenterOffsetX == B.CenterOffsetX && A.CenterOffsetY == B.CenterOffsetY;
+}
+
+bool FPointCloudConverter::ConvertIncremental(const FDepthConversionParams& InParams, const uint16* Depth, const uint32* Color, FPointCloudBuffer& Points, uint32& PointsVersion)
+{
+	const FDepthConversionParams Params = UpdateRays(InParams);
+	const int32 NumPoints = Params.Width * Params.Height;
+	const int32 TilesX = FMath::DivideAndRoundUp(Params.Width, TILE_SIZE);
+	const int32 TilesY = FMath::DivideAndRoundUp(Params.Height, TILE_SIZE);
+
+	// Different geometry invalidates every converted point
+	const bool bReset = TileVersions.Num() != TilesX * TilesY || !SameConversion(Params, ReferenceParams);
+	if (bReset)
+	{
+		ReferenceDepth.SetNumUninitialized(NumPoints);
+		ReferenceColor.SetNumUninitialized(NumPoints);
+		TileVersions.SetNum(TilesX * TilesY);
+		ReferenceParams = Params;
+	}
+
+	if (Points.Num() != NumPoints || Points.Valid.Num() != NumPoints)
+	{
+		Points.SetNum(NumPoints, true);
+		PointsVersion = 0;
+	}
+
+	++Version;
+	FThreadSafeCounter DirtyTiles;
+	const uint32 OutputVersion = PointsVersion;
+
+	// Same worker count as Convert, each band takes whole rows of tiles
+	const int32 NumBands = FMath::Min(GetNumBands(Params), TilesY);
+	ParallelFor(NumBands, [&](int32 Band)
+	{
+		const int32 TileYBegin = (int64)TilesY * Band / NumBands;
+		const int32 TileYEnd = (int64)TilesY * (Band + 1) / NumBands;
+
+		for (int32 TileY = TileYBegin; TileY < TileYEnd; ++TileY)
+		{
+			const int32 RowBegin = TileY * TILE_SIZE;
+			const int32 RowEnd = FMath::Min(RowBegin + TILE_SIZE, Params.Height);
+
+			for (int32 TileX = 0; TileX < TilesX; ++TileX)
+			{
+				const int32 ColBegin = TileX * TILE_SIZE;
+				const int32 ColEnd = FMath::Min(ColBegin + TILE_SIZE, Params.Width);
+				uint32& TileVersion = TileVersions[TileY * TilesX + TileX];
+
+				if (bReset || TileVersion == 0 || TileChanged(Params, Depth, Color, ReferenceDepth.GetData(), ReferenceColor.GetData(), RowBegin, RowEnd, ColBegin, ColEnd))
+				{
+					for (int32 Row = RowBegin; Row < RowEnd; ++Row)
+					{
+						const int32 Offset = Row * Params.Width + ColBegin;
+						FMemory::Memcpy(ReferenceDepth.GetData() + Offset, Depth + Offset, (ColEnd - ColBegin) * sizeof(uint16));
+						FMemory::Memcpy(ReferenceColor.GetData() + Offset, Color + Offset, (ColEnd - ColBegin) * sizeof(uint32));
+					}
+					TileVersion = Version;
+					DirtyTiles.Increment();
+				}
+
+				// Converted from the reference so the tile matches what other outputs got for this version
+				if (TileVersion > OutputVersion)
+				{
+					ConvertRect(Params, ReferenceDepth.GetData(), ReferenceColor.GetData(), Points, RowBegin, RowEnd, ColBegin, ColEnd);
+				}
+			}
+		}
+	}, NumBands == 1);
+
+	PointsVersion = Version;
+	NumDirtyTiles = DirtyTiles.GetValue();
+	return NumDirtyTiles > 0;
+}
+
+void FPointCloudConverter::SetDeprojection(FDepthDeprojection InDeprojection)
+{
+	Deprojection = MoveTemp(InDeprojection);
+	bRaysValid = false;
+}
+
+FDepthConversionParams FPointCloudConverter::UpdateRays(const FDepthConversionParams& Params)
+{
+	const bool bSameRays = bRaysValid && Params.Width == RayParams.Width && Params.Height == RayParams.Height
+		&& Params.ScaleX == RayParams.ScaleX && Params.ScaleY == RayParams.ScaleY
+		&& Params.CenterOffsetX == RayParams.CenterOffsetX && Params.CenterOffsetY == RayParams.CenterOffsetY
+		&& Params.PixelStep == RayParams.PixelStep && Params.PixelOffsetX == RayParams.PixelOffsetX && Params.PixelOffsetY == RayParams.PixelOffsetY;
+
+	if (!bSameRays)
+	{
+		const int32 NumPixels = Params.Width * Params.Height;
+		RayTableX.SetNumUninitialized(NumPixels, false);
+		RayTableY.SetNumUninitialized(NumPixels, false);
+
+		// Same model the kernel uses without a table, output is (-x, -z, -y) so the rays are stored negated
+		const float CenterX = (int32)(0.5 * Params.Width) + Params.CenterOffsetX;
+		const float CenterY = (int32)(0.5 * Params.Height) + Params.CenterOffsetY;
+
+		const int32 NumBands = GetNumBands(Params);
+		ParallelFor(NumBands, [&](int32 Band)
+		{
+			const int32 RowBegin = (int64)Params.Height * Band / NumBands;
+			const int32 RowEnd = (int64)Params.Height * (Band + 1) / NumBands;
+
+			for (int32 Row = RowBegin; Row < RowEnd; ++Row)
+			{
+				for (int32 Col = 0; Col < Params.Width; ++Col)
+				{
+					const int32 Index = Row * Params.Width + Col;
+					if (Deprojection)
+					{
+						float X, Y;
+						Deprojection(Col * Params.PixelStep + Params.PixelOffsetX, Row * Params.PixelStep + Params.PixelOffsetY, X, Y);
+						RayTableX[Index] = -X;
+						RayTableY[Index] = -Y;
+					}
+					else
+					{
+						RayTableX[Index] = -(Col - CenterX - 0.5f) * Params.ScaleX;
+						RayTableY[Index] = -(Row - CenterY - 0.5f) * Params.ScaleY;
+					}
+				}
+			}
+		}, NumBands == 1);
+
+		RayParams = Params;
+		bRaysValid = true;
+
+		// Points converted with the old rays are stale
+		ResetTiles();
+	}
+
+	FDepthConversionParams Out = Params;
+	Out.RayTableX = RayTableX.GetData();
+	Out.RayTableY = RayTableY.GetData();
+	return Out;
+}
+
+void FPointCloudConverter::ResetTiles()
+{
+	TileVersions.Reset();
+}
+
+void FPointCloudConverter::Upload(ULidarPointCloud* Cloud, const FPointCloudBuffer& Points, TArray<FLidarPointCloudPoint>& LidarPoints, const FBox& PointsBounds, FBox& CloudBounds)
+{
+	bool bBoundsChanged = false;
+
+	// Grow by half again plus a margin, so a moving sensor only occasionally forces a new box
+	if (PointsBounds.IsValid && (!CloudBounds.IsValid || !CloudBounds.IsInside(PointsBounds)))
+	{
+		const FBox Bounds = CloudBounds.IsValid ? CloudBounds + PointsBounds : PointsBounds;
+		CloudBounds = Bounds.ExpandBy(0.5f * Bounds.GetExtent() + FVector(CLOUD_BOUNDS_MARGIN));
+		bBoundsChanged = true;
+	}
+
+	if (!CloudBounds.IsValid)
+	{
+		CloudBounds = FBox(FVector(-CLOUD_BOUNDS_MARGIN), FVector(CLOUD_BOUNDS_MARGIN));
+		bBoundsChanged = true;
+	}
+
+	// The only place points take the LiDAR layout
+	Points.ToLidarPoints(LidarPoints);
+
+	// Only a new box needs a new octree, otherwise the points are swapped out and the nodes reused
+	if (bBoundsChanged)
+	{
+		Cloud->Initialize(CloudBounds);
+	}
+	else
+	{
+		Cloud->Octree.Empty(false);
+	}
+
+	if (LidarPoints.Num() > 0)
+	{
+		Cloud->InsertPoints(LidarPoints, ELidarPointCloudDuplicateHandling::Ignore, false, FVector(0, 0, 0));
+	}
+	Cloud->RefreshRendering();
+}
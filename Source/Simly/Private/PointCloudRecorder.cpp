@@ -0,0 +1,259 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "PointCloudRecorder.h"
+#include "HAL/PlatformFilemanager.h"
+#include "HAL/RunnableThread.h"
+#include "Async/Async.h"
+
+// Staging buffers are written out in whole, page aligned blocks
+#define STAGING_ALIGNMENT 4096
+#define STAGING_SIZE (8 * 1024 * 1024)
+#define IDLE_WAIT_MS 100
+
+FPointCloudRecorder::~FPointCloudRecorder()
+{
+	Close();
+}
+
+bool FPointCloudRecorder::Open(const FString& FileName, EPointCloudVideoCodec InDepthCodec, EPointCloudVideoCodec InColorCodec, int32 InColorQuality, int32 NumSlots)
+{
+	Close();
+
+	if (!FPointCloudVideoCodec::IsDepthCodec(InDepthCodec) || !FPointCloudVideoCodec::IsColorCodec(InColorCodec)) return false;
+
+	IFileHandle* FileHandle = FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*FileName);
+	if (!FileHandle)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[Point Cloud Recorder] Unable to create %s."), *FileName);
+		return false;
+	}
+	Sink.Reset(FileHandle);
+
+	DepthCodec = InDepthCodec;
+	ColorCodec = InColorCodec;
+	ColorQuality = InColorQuality;
+	bHasFirstFrame = false;
+	RecordedFrames.Reset();
+	DroppedFrames.Reset();
+
+	Slots.SetNum(FMath::Max(NumSlots, 2));
+	for (int32 i = 0; i < Slots.Num(); ++i) FreeSlots.Enqueue(i);
+
+	WorkEvent = FPlatformProcess::GetSynchEventFromPool(false);
+	bStopping = false;
+	bAccepting = true;
+
+	FString ThreadName(FString::Printf(TEXT("FPointCloudRecorder_%s"), *FGuid::NewGuid().ToString()));
+	Thread.Reset(FRunnableThread::Create(this, *ThreadName, 0, TPri_BelowNormal));
+	if (!Thread.Get())
+	{
+		UE_LOG(LogTemp, Error, TEXT("[Point Cloud Recorder] Unable to create thread."));
+		Close();
+		return false;
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("[Point Cloud Recorder] Recording to %s."), *FileName);
+	return true;
+}
+
+void FPointCloudRecorder::Close()
+{
+	{
+		// Waits for a SubmitFrame that is still copying into a slot
+		FScopeLock Lock(&SubmitMx);
+		bAccepting = false;
+	}
+
+	if (Thread.Get())
+	{
+		bStopping = true;
+		WorkEvent->Trigger();
+		Thread->WaitForCompletion();
+		Thread.Reset();
+
+		UE_LOG(LogTemp, Log, TEXT("[Point Cloud Recorder] Stopped, %d frames recorded, %d dropped."), RecordedFrames.GetValue(), DroppedFrames.GetValue());
+	}
+
+	if (WorkEvent)
+	{
+		FPlatformProcess::ReturnSynchEventToPool(WorkEvent);
+		WorkEvent = nullptr;
+	}
+
+	Sink.Reset(nullptr);
+
+	int32 SlotIndex;
+	while (ReadySlots.Dequeue(SlotIndex)) {}
+	while (FreeSlots.Dequeue(SlotIndex)) {}
+	Slots.Empty();
+}
+
+bool FPointCloudRecorder::SubmitFrame(uint64 Timestamp, int32 InWidth, int32 InHeight, const uint16* Depth, const uint32* Color)
+{
+	FScopeLock Lock(&SubmitMx);
+	if (!bAccepting) return false;
+
+	// All slots still waiting on the encoder or the disk
+	int32 SlotIndex;
+	if (!FreeSlots.Dequeue(SlotIndex))
+	{
+		DroppedFrames.Increment();
+		return false;
+	}
+
+	if (!bHasFirstFrame)
+	{
+		FirstTimestamp = Timestamp;
+		bHasFirstFrame = true;
+	}
+
+	FFrameSlot& Slot = Slots[SlotIndex];
+	Slot.Timestamp = Timestamp > FirstTimestamp ? Timestamp - FirstTimestamp : 0;
+	Slot.Width = InWidth;
+	Slot.Height = InHeight;
+	Slot.Depth.SetNumUninitialized(InWidth * InHeight, false);
+	Slot.Color.SetNumUninitialized(InWidth * InHeight, false);
+	FMemory::Memcpy(Slot.Depth.GetData(), Depth, Slot.Depth.Num() * sizeof(uint16));
+	FMemory::Memcpy(Slot.Color.GetData(), Color, Slot.Color.Num() * sizeof(uint32));
+
+	ReadySlots.Enqueue(SlotIndex);
+	WorkEvent->Trigger();
+	return true;
+}
+
+uint32 FPointCloudRecorder::Run()
+{
+	while (true)
+	{
+		int32 SlotIndex;
+		if (ReadySlots.Dequeue(SlotIndex))
+		{
+			WriteFrame(Slots[SlotIndex]);
+			FreeSlots.Enqueue(SlotIndex);
+			continue;
+		}
+
+		if (bStopping)
+		{
+			// Nothing is submitted once stopping, but a last frame may have raced the flag
+			if (ReadySlots.IsEmpty()) break;
+			continue;
+		}
+
+		WorkEvent->Wait(IDLE_WAIT_MS);
+	}
+
+	// Nothing was recorded, still leave a valid empty file behind
+	if (!Writer.IsOpen()) Writer.Open(Sink, 0, 0, DepthCodec, ColorCodec, ColorQuality);
+
+	if (!Writer.Close())
+	{
+		UE_LOG(LogTemp, Error, TEXT("[Point Cloud Recorder] Writing the recording failed, the file is incomplete."));
+	}
+	return 0;
+}
+
+void FPointCloudRecorder::WriteFrame(const FFrameSlot& Slot)
+{
+	if (!Writer.IsOpen() && !Writer.Open(Sink, Slot.Width, Slot.Height, DepthCodec, ColorCodec, ColorQuality))
+	{
+		DroppedFrames.Increment();
+		return;
+	}
+
+	if (Writer.HasFailed() || Slot.Width != Writer.GetWidth() || Slot.Height != Writer.GetHeight()
+		|| !Writer.WriteFrame(Slot.Timestamp, Slot.Depth.GetData(), Slot.Color.GetData()))
+	{
+		DroppedFrames.Increment();
+		return;
+	}
+
+	RecordedFrames.Increment();
+}
+
+void FPointCloudRecorder::FStagingSink::Reset(IFileHandle* InFileHandle)
+{
+	WaitForPendingWrite();
+	delete FileHandle;
+	FileHandle = InFileHandle;
+	StagingUsed = 0;
+	ActiveStaging = 0;
+	bWriteFailed = false;
+
+	if (FileHandle && !Staging[0])
+	{
+		Staging[0] = (uint8*)FMemory::Malloc(STAGING_SIZE, STAGING_ALIGNMENT);
+		Staging[1] = (uint8*)FMemory::Malloc(STAGING_SIZE, STAGING_ALIGNMENT);
+	}
+	else if (!FileHandle)
+	{
+		FMemory::Free(Staging[0]);
+		FMemory::Free(Staging[1]);
+		Staging[0] = Staging[1] = nullptr;
+	}
+}
+
+bool FPointCloudRecorder::FStagingSink::Write(const void* Data, int64 Size)
+{
+	if (bWriteFailed || !FileHandle) return false;
+
+	const uint8* Bytes = (const uint8*)Data;
+	while (Size > 0)
+	{
+		const int64 Chunk = FMath::Min<int64>(Size, STAGING_SIZE - StagingUsed);
+		FMemory::Memcpy(Staging[ActiveStaging] + StagingUsed, Bytes, Chunk);
+		StagingUsed += Chunk;
+		Bytes += Chunk;
+		Size -= Chunk;
+
+		if (StagingUsed == STAGING_SIZE) SubmitStaging();
+	}
+
+	// A failed disk write only shows up once the next buffer is submitted
+	return !bWriteFailed;
+}
+
+bool FPointCloudRecorder::FStagingSink::Flush()
+{
+	if (!FileHandle) return false;
+
+	SubmitStaging();
+	WaitForPendingWrite();
+	return FileHandle->Flush() && !bWriteFailed;
+}
+
+void FPointCloudRecorder::FStagingSink::SubmitStaging()
+{
+	// One write in flight at a time, the other buffer keeps filling meanwhile
+	WaitForPendingWrite();
+	if (StagingUsed == 0) return;
+
+	IFileHandle* File = FileHandle;
+	const uint8* Data = Staging[ActiveStaging];
+	const int64 Size = StagingUsed;
+	PendingWrite = Async(EAsyncExecution::ThreadPool, [File, Data, Size]()
+	{
+		return File->Write(Data, Size);
+	});
+
+	ActiveStaging ^= 1;
+	StagingUsed = 0;
+}
+
+void FPointCloudRecorder::FStagingSink::WaitForPendingWrite()
+{
+	if (!PendingWrite.IsValid()) return;
+
+	if (!PendingWrite.Get() && !bWriteFailed)
+	{
+		UE_LOG(LogTemp, Error, TEXT("[Point Cloud Recorder] Disk write failed, dropping further frames."));
+		bWriteFailed = true;
+	}
+	PendingWrite = TFuture<bool>();
+}
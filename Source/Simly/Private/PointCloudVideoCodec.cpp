@@ -0,0 +1,130 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "PointCloudVideoCodec.h"
+#include "RVLCodec.h"
+#include "IImageWrapper.h"
+#include "IImageWrapperModule.h"
+#include "Modules/ModuleManager.h"
+
+void FPointCloudVideoCodec::EncodeRVL(const uint16* Depth, int32 NumPixels, TArray<uint8>& OutData)
+{
+	OutData.Reset();
+	OutData.Reserve(NumPixels);
+
+	RVL::encode(Depth, NumPixels, [&OutData](const unsigned char* Bytes, size_t Length)
+	{
+		OutData.Append(Bytes, (int32)Length);
+	});
+}
+
+bool FPointCloudVideoCodec::DecodeRVL(const uint8* Data, int32 Size, uint16* OutDepth, int32 NumPixels)
+{
+	if (Size < 0 || NumPixels < 0) return false;
+	return RVL::decode(Data, Size, OutDepth, NumPixels);
+}
+
+bool FPointCloudVideoCodec::EncodeDepth(EPointCloudVideoCodec Codec, const uint16* Depth, int32 NumPixels, TArray<uint8>& OutData)
+{
+	switch (Codec)
+	{
+	case EPointCloudVideoCodec::Raw:
+		OutData.SetNumUninitialized(NumPixels * sizeof(uint16), false);
+		FMemory::Memcpy(OutData.GetData(), Depth, OutData.Num());
+		return true;
+
+	case EPointCloudVideoCodec::RVL:
+		EncodeRVL(Depth, NumPixels, OutData);
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+bool FPointCloudVideoCodec::DecodeDepth(EPointCloudVideoCodec Codec, const uint8* Data, int32 Size, uint16* OutDepth, int32 NumPixels)
+{
+	switch (Codec)
+	{
+	case EPointCloudVideoCodec::Raw:
+		if (Size < NumPixels * (int32)sizeof(uint16)) return false;
+		FMemory::Memcpy(OutDepth, Data, NumPixels * sizeof(uint16));
+		return true;
+
+	case EPointCloudVideoCodec::RVL:
+		return DecodeRVL(Data, Size, OutDepth, NumPixels);
+
+	default:
+		return false;
+	}
+}
+
+bool FPointCloudVideoCodec::EncodeColor(EPointCloudVideoCodec Codec, const uint32* Color, int32 Width, int32 Height, int32 Quality, TArray<uint8>& OutData)
+{
+	const int32 RawSize = Width * Height * sizeof(uint32);
+
+	switch (Codec)
+	{
+	case EPointCloudVideoCodec::Raw:
+		OutData.SetNumUninitialized(RawSize, false);
+		FMemory::Memcpy(OutData.GetData(), Color, RawSize);
+		return true;
+
+	case EPointCloudVideoCodec::Jpeg:
+	{
+		IImageWrapper* Wrapper = GetJpegWrapper();
+		if (!Wrapper || !Wrapper->SetRaw(Color, RawSize, Width, Height, ERGBFormat::RGBA, 8)) return false;
+
+		const TArray64<uint8>& Compressed = Wrapper->GetCompressed(FMath::Clamp(Quality, 1, 100));
+		OutData.SetNumUninitialized(Compressed.Num(), false);
+		FMemory::Memcpy(OutData.GetData(), Compressed.GetData(), Compressed.Num());
+		return OutData.Num() > 0;
+	}
+
+	default:
+		return false;
+	}
+}
+
+bool FPointCloudVideoCodec::DecodeColor(EPointCloudVideoCodec Codec, const uint8* Data, int32 Size, uint32* OutColor, int32 Width, int32 Height)
+{
+	const int32 RawSize = Width * Height * sizeof(uint32);
+
+	switch (Codec)
+	{
+	case EPointCloudVideoCodec::Raw:
+		if (Size < RawSize) return false;
+		FMemory::Memcpy(OutColor, Data, RawSize);
+		return true;
+
+	case EPointCloudVideoCodec::Jpeg:
+	{
+		IImageWrapper* Wrapper = GetJpegWrapper();
+		if (!Wrapper || !Wrapper->SetCompressed(Data, Size)) return false;
+		if (Wrapper->GetWidth() != Width || Wrapper->GetHeight() != Height) return false;
+		if (!Wrapper->GetRaw(ERGBFormat::RGBA, 8, RawColor) || RawColor.Num() != RawSize) return false;
+
+		FMemory::Memcpy(OutColor, RawColor.GetData(), RawSize);
+		return true;
+	}
+
+	default:
+		return false;
+	}
+}
+
+IImageWrapper* FPointCloudVideoCodec::GetJpegWrapper()
+{
+	// The module itself is loaded on startup by FSimlyModule, getting it is safe from any thread
+	if (!JpegWrapper.IsValid())
+	{
+		IImageWrapperModule& ImageWrapperModule = FModuleManager::GetModuleChecked<IImageWrapperModule>(TEXT("ImageWrapper"));
+		JpegWrapper = ImageWrapperModule.CreateImageWrapper(EImageFormat::JPEG);
+	}
+	return JpegWrapper.Get();
+}
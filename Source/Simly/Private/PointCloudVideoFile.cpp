@@ -0,0 +1,218 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "PointCloudVideoFile.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Async/MappedFileHandle.h"
+#include "Algo/BinarySearch.h"
+
+FPointCloudVideoFile::~FPointCloudVideoFile()
+{
+	Close();
+}
+
+bool FPointCloudVideoFile::Open(const FString& FileName)
+{
+	Close();
+
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	MappedHandle = PlatformFile.OpenMapped(*FileName);
+	if (MappedHandle)
+	{
+		FileSize = MappedHandle->GetFileSize();
+		MappedRegion = FileSize > 0 ? MappedHandle->MapRegion(0, FileSize) : nullptr;
+		if (MappedRegion)
+		{
+			MappedData = MappedRegion->GetMappedPtr();
+		}
+		else
+		{
+			delete MappedHandle;
+			MappedHandle = nullptr;
+		}
+	}
+
+	// Not every platform can map files, fall back to reading each frame
+	if (!MappedRegion)
+	{
+		FileHandle = PlatformFile.OpenRead(*FileName);
+		if (!FileHandle)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("[Point Cloud Video] Unable to open %s."), *FileName);
+			return false;
+		}
+		FileSize = FileHandle->Size();
+	}
+
+	uint32 Magic = 0;
+	if (const uint8* Data = Fetch(0, sizeof(Magic))) FMemory::Memcpy(&Magic, Data, sizeof(Magic));
+
+	if (Magic == POINTCLOUD_VIDEO_MAGIC)
+	{
+		const uint8* Data = Fetch(0, sizeof(FPointCloudVideoHeader));
+		if (!Data)
+		{
+			Close();
+			return false;
+		}
+
+		FPointCloudVideoHeader Header;
+		FMemory::Memcpy(&Header, Data, sizeof(Header));
+		if (Header.Version != POINTCLOUD_VIDEO_VERSION)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("[Point Cloud Video] Unsupported version %u in %s."), Header.Version, *FileName);
+			Close();
+			return false;
+		}
+
+		Version = Header.Version;
+		Width = Header.Width;
+		Height = Header.Height;
+		DepthCodec = Header.DepthCodec;
+		ColorCodec = Header.ColorCodec;
+		FrameHeaderSize = sizeof(FPointCloudVideoFrameHeader);
+
+		if (!ReadIndex())
+		{
+			UE_LOG(LogTemp, Warning, TEXT("[Point Cloud Video] No index in %s, scanning frames."), *FileName);
+			ScanFrames(sizeof(FPointCloudVideoHeader));
+		}
+	}
+	else
+	{
+		const uint8* Data = Fetch(0, sizeof(FPointCloudVideoHeaderV1));
+		if (!Data)
+		{
+			Close();
+			return false;
+		}
+
+		FPointCloudVideoHeaderV1 Header;
+		FMemory::Memcpy(&Header, Data, sizeof(Header));
+
+		Version = 1;
+		Width = Header.Width;
+		Height = Header.Height;
+		FrameHeaderSize = sizeof(uint64);
+		ScanFrames(sizeof(FPointCloudVideoHeaderV1));
+	}
+
+	return true;
+}
+
+void FPointCloudVideoFile::Close()
+{
+	delete MappedRegion;
+	MappedRegion = nullptr;
+	MappedData = nullptr;
+
+	delete MappedHandle;
+	MappedHandle = nullptr;
+
+	delete FileHandle;
+	FileHandle = nullptr;
+
+	Scratch.Empty();
+	Index.Empty();
+	FileSize = 0;
+	Version = 0;
+	Width = Height = 0;
+}
+
+int32 FPointCloudVideoFile::FindFrame(uint64 Timestamp) const
+{
+	const int32 Upper = Algo::UpperBoundBy(Index, Timestamp, &FPointCloudVideoIndexEntry::Timestamp);
+	return FMath::Max(Upper - 1, 0);
+}
+
+bool FPointCloudVideoFile::GetFrame(int32 Frame, FPointCloudVideoFrame& OutFrame)
+{
+	if (!Index.IsValidIndex(Frame)) return false;
+
+	const FPointCloudVideoIndexEntry& Entry = Index[Frame];
+	const uint8* Data = Fetch(Entry.Offset + FrameHeaderSize, (int64)Entry.DepthSize + Entry.ColorSize);
+	if (!Data) return false;
+
+	OutFrame.Timestamp = Entry.Timestamp;
+	OutFrame.Depth = Data;
+	OutFrame.DepthSize = Entry.DepthSize;
+	OutFrame.Color = Data + Entry.DepthSize;
+	OutFrame.ColorSize = Entry.ColorSize;
+	return true;
+}
+
+const uint8* FPointCloudVideoFile::Fetch(int64 Offset, int64 Length)
+{
+	if (Offset < 0 || Length <= 0 || Offset + Length > FileSize) return nullptr;
+	if (MappedData) return MappedData + Offset;
+
+	if (!FileHandle || Length > MAX_int32 || !FileHandle->Seek(Offset)) return nullptr;
+	Scratch.SetNumUninitialized((int32)Length, false);
+	if (!FileHandle->Read(Scratch.GetData(), Length)) return nullptr;
+	return Scratch.GetData();
+}
+
+bool FPointCloudVideoFile::ReadIndex()
+{
+	const int64 TrailerOffset = FileSize - (int64)sizeof(FPointCloudVideoTrailer);
+	const uint8* Data = Fetch(TrailerOffset, sizeof(FPointCloudVideoTrailer));
+	if (!Data || TrailerOffset < (int64)sizeof(FPointCloudVideoHeader)) return false;
+
+	FPointCloudVideoTrailer Trailer;
+	FMemory::Memcpy(&Trailer, Data, sizeof(Trailer));
+
+	const int64 IndexSize = (int64)Trailer.NumFrames * sizeof(FPointCloudVideoIndexEntry);
+	if (Trailer.Magic != POINTCLOUD_VIDEO_MAGIC || (int64)Trailer.IndexOffset + IndexSize != TrailerOffset) return false;
+	if (Trailer.NumFrames == 0) return true;
+
+	const uint8* Entries = Fetch(Trailer.IndexOffset, IndexSize);
+	if (!Entries) return false;
+
+	Index.SetNumUninitialized(Trailer.NumFrames);
+	FMemory::Memcpy(Index.GetData(), Entries, IndexSize);
+	return true;
+}
+
+bool FPointCloudVideoFile::ScanFrames(int64 Offset)
+{
+	Index.Reset();
+
+	// v1 frames are raw and fixed size, v2 frames carry their own sizes
+	const uint32 RawDepthSize = Width * Height * sizeof(uint16);
+	const uint32 RawColorSize = Width * Height * sizeof(uint32);
+
+	while (const uint8* Data = Fetch(Offset, FrameHeaderSize))
+	{
+		FPointCloudVideoIndexEntry Entry;
+		Entry.Offset = Offset;
+
+		if (Version == 1)
+		{
+			FMemory::Memcpy(&Entry.Timestamp, Data, sizeof(uint64));
+			Entry.DepthSize = RawDepthSize;
+			Entry.ColorSize = RawColorSize;
+		}
+		else
+		{
+			FPointCloudVideoFrameHeader Header;
+			FMemory::Memcpy(&Header, Data, sizeof(Header));
+			Entry.Timestamp = Header.Timestamp;
+			Entry.DepthSize = Header.DepthSize;
+			Entry.ColorSize = Header.ColorSize;
+		}
+
+		// Stop at a truncated frame
+		const int64 FrameSize = FrameHeaderSize + (int64)Entry.DepthSize + Entry.ColorSize;
+		if (Offset + FrameSize > FileSize) break;
+
+		Index.Add(Entry);
+		Offset += FrameSize;
+	}
+
+	return Index.Num() > 0;
+}
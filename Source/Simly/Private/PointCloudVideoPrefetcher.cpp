@@ -0,0 +1,208 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "PointCloudVideoPrefetcher.h"
+#include "HAL/RunnableThread.h"
+
+#define IDLE_WAIT_MS 10
+
+FPointCloudVideoPrefetcher::~FPointCloudVideoPrefetcher()
+{
+	Close();
+}
+
+bool FPointCloudVideoPrefetcher::Open(FPointCloudVideoFile* InVideo, int32 NumSlots, int32 FirstFrame)
+{
+	Close();
+	if (!InVideo || !InVideo->IsOpen()) return false;
+
+	Video = InVideo;
+	NextFrame = FirstFrame;
+	Generation = 0;
+
+	Slots.SetNum(FMath::Max(NumSlots, 1));
+	for (int32 i = 0; i < Slots.Num(); ++i) FreeSlots.Enqueue(i);
+
+	WorkEvent = FPlatformProcess::GetSynchEventFromPool(false);
+	ReadyEvent = FPlatformProcess::GetSynchEventFromPool(false);
+	bStopping = false;
+
+	FString ThreadName(FString::Printf(TEXT("FPointCloudVideoPrefetcher_%s"), *FGuid::NewGuid().ToString()));
+	Thread.Reset(FRunnableThread::Create(this, *ThreadName, 0, TPri_Normal));
+	if (!Thread.Get())
+	{
+		UE_LOG(LogTemp, Error, TEXT("[Point Cloud Video] Unable to create prefetch thread."));
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void FPointCloudVideoPrefetcher::Close()
+{
+	if (Thread.Get())
+	{
+		bStopping = true;
+		WorkEvent->Trigger();
+		Thread->WaitForCompletion();
+		Thread.Reset();
+	}
+
+	if (WorkEvent)
+	{
+		FPlatformProcess::ReturnSynchEventToPool(WorkEvent);
+		WorkEvent = nullptr;
+	}
+	if (ReadyEvent)
+	{
+		FPlatformProcess::ReturnSynchEventToPool(ReadyEvent);
+		ReadyEvent = nullptr;
+	}
+
+	int32 SlotIndex;
+	while (ReadySlots.Dequeue(SlotIndex)) {}
+	while (FreeSlots.Dequeue(SlotIndex)) {}
+	Slots.Empty();
+	Video = nullptr;
+}
+
+void FPointCloudVideoPrefetcher::Seek(int32 Frame)
+{
+	{
+		FScopeLock Lock(&SeekMx);
+		NextFrame = Frame;
+		Generation++;
+	}
+	WorkEvent->Trigger();
+}
+
+int32 FPointCloudVideoPrefetcher::Acquire(int32 Frame, uint32 WaitMs)
+{
+	if (!Thread.Get()) return INDEX_NONE;
+
+	bool bWaited = false;
+	while (true)
+	{
+		uint32 CurrentGeneration;
+		int32 ReadFrame;
+		{
+			FScopeLock Lock(&SeekMx);
+			CurrentGeneration = Generation;
+			ReadFrame = NextFrame;
+		}
+
+		int32 SlotIndex;
+		if (!ReadySlots.Peek(SlotIndex))
+		{
+			// The frame was passed already, or is so far ahead that reading up to it would only fall further behind.
+			// ReadFrame - 1 may still be in flight
+			if (Frame < ReadFrame - 1 || Frame >= ReadFrame + Slots.Num()) Seek(Frame);
+
+			if (bWaited) return INDEX_NONE;
+			ReadyEvent->Wait(WaitMs);
+			bWaited = true;
+			continue;
+		}
+
+		const FPrefetchedFrame& Slot = Slots[SlotIndex];
+		if (Slot.Generation == CurrentGeneration && Slot.Frame == Frame)
+		{
+			ReadySlots.Pop();
+			return SlotIndex;
+		}
+
+		// Read before a seek or a frame playback skipped, anything past the wanted frame needs a seek back
+		ReadySlots.Pop();
+		if (Slot.Generation == CurrentGeneration && Slot.Frame > Frame) Seek(Frame);
+		Release(SlotIndex);
+	}
+}
+
+void FPointCloudVideoPrefetcher::Release(int32 SlotIndex)
+{
+	FreeSlots.Enqueue(SlotIndex);
+	WorkEvent->Trigger();
+}
+
+uint32 FPointCloudVideoPrefetcher::Run()
+{
+	// Slot taken from the free queue but not filled yet, kept while waiting at the end of the video
+	int32 SlotIndex = INDEX_NONE;
+
+	while (!bStopping)
+	{
+		// Every slot is still waiting for the consumer
+		if (SlotIndex == INDEX_NONE && !FreeSlots.Dequeue(SlotIndex))
+		{
+			SlotIndex = INDEX_NONE;
+			WorkEvent->Wait(IDLE_WAIT_MS);
+			continue;
+		}
+
+		int32 Frame;
+		uint32 FrameGeneration;
+		{
+			FScopeLock Lock(&SeekMx);
+			if (NextFrame >= Video->NumFrames() && bLoop) NextFrame = 0;
+			Frame = NextFrame;
+			FrameGeneration = Generation;
+			if (Frame < Video->NumFrames()) NextFrame++;
+		}
+
+		// Past the end, wait for a seek or a loop
+		if (Frame >= Video->NumFrames())
+		{
+			WorkEvent->Wait(IDLE_WAIT_MS);
+			continue;
+		}
+
+		FPrefetchedFrame& Slot = Slots[SlotIndex];
+		Slot.Frame = Frame;
+		Slot.Generation = FrameGeneration;
+		Slot.bValid = ReadFrame(Frame, Slot);
+
+		ReadySlots.Enqueue(SlotIndex);
+		ReadyEvent->Trigger();
+		SlotIndex = INDEX_NONE;
+	}
+	return 0;
+}
+
+bool FPointCloudVideoPrefetcher::ReadFrame(int32 Frame, FPrefetchedFrame& Slot)
+{
+	FPointCloudVideoFrame VideoFrame;
+	if (!Video->GetFrame(Frame, VideoFrame)) return false;
+
+	// Raw frames are copied out of the file here too, so page faults on a mapped file hit this thread
+	const int32 NumPixels = Video->GetWidth() * Video->GetHeight();
+	Slot.Depth.SetNumUninitialized(NumPixels, false);
+	Slot.Color.SetNumUninitialized(NumPixels, false);
+
+	if (Video->GetDepthCodec() == EPointCloudVideoCodec::Raw)
+	{
+		if (VideoFrame.DepthSize < NumPixels * sizeof(uint16)) return false;
+		FMemory::Memcpy(Slot.Depth.GetData(), VideoFrame.Depth, NumPixels * sizeof(uint16));
+	}
+	else if (!Codec.DecodeDepth(Video->GetDepthCodec(), VideoFrame.Depth, VideoFrame.DepthSize, Slot.Depth.GetData(), NumPixels))
+	{
+		return false;
+	}
+
+	if (Video->GetColorCodec() == EPointCloudVideoCodec::Raw)
+	{
+		if (VideoFrame.ColorSize < NumPixels * sizeof(uint32)) return false;
+		FMemory::Memcpy(Slot.Color.GetData(), VideoFrame.Color, NumPixels * sizeof(uint32));
+	}
+	else if (!Codec.DecodeColor(Video->GetColorCodec(), VideoFrame.Color, VideoFrame.ColorSize, Slot.Color.GetData(), Video->GetWidth(), Video->GetHeight()))
+	{
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,153 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "PointCloudVideoWriter.h"
+#include "HAL/PlatformFilemanager.h"
+
+/** Writes straight to a file on the calling thread. */
+class FPointCloudVideoFileSink : public IPointCloudVideoSink
+{
+public:
+	explicit FPointCloudVideoFileSink(IFileHandle* InFileHandle) : FileHandle(InFileHandle) {}
+	virtual ~FPointCloudVideoFileSink() { delete FileHandle; }
+
+	virtual bool Write(const void* Data, int64 Size) override { return FileHandle->Write((const uint8*)Data, Size); }
+	virtual bool Flush() override { return FileHandle->Flush(); }
+
+private:
+	IFileHandle* FileHandle;
+};
+
+FPointCloudVideoWriter::~FPointCloudVideoWriter()
+{
+	Close();
+}
+
+bool FPointCloudVideoWriter::Open(const FString& FileName, int32 InWidth, int32 InHeight, EPointCloudVideoCodec InDepthCodec, EPointCloudVideoCodec InColorCodec, int32 InColorQuality)
+{
+	Close();
+
+	IFileHandle* FileHandle = FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*FileName);
+	if (!FileHandle)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[Point Cloud Video] Unable to create %s."), *FileName);
+		return false;
+	}
+
+	OwnedSink.Reset(new FPointCloudVideoFileSink(FileHandle));
+	if (!Open(*OwnedSink, InWidth, InHeight, InDepthCodec, InColorCodec, InColorQuality))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[Point Cloud Video] Unable to start %s."), *FileName);
+		OwnedSink.Reset();
+		return false;
+	}
+	return true;
+}
+
+bool FPointCloudVideoWriter::Open(IPointCloudVideoSink& InSink, int32 InWidth, int32 InHeight, EPointCloudVideoCodec InDepthCodec, EPointCloudVideoCodec InColorCodec, int32 InColorQuality)
+{
+	// Open(FileName) has already closed and set OwnedSink, which Close would release
+	if (Sink)
+	{
+		Close();
+	}
+
+	// 0 x 0 is an empty recording, only the header, index and trailer are written
+	if (InWidth < 0 || InHeight < 0 || !FPointCloudVideoCodec::IsDepthCodec(InDepthCodec) || !FPointCloudVideoCodec::IsColorCodec(InColorCodec))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[Point Cloud Video] Invalid recording settings."));
+		return false;
+	}
+
+	Sink = &InSink;
+	Width = InWidth;
+	Height = InHeight;
+	DepthCodec = InDepthCodec;
+	ColorCodec = InColorCodec;
+	ColorQuality = InColorQuality;
+	Offset = 0;
+	bFailed = false;
+
+	FPointCloudVideoHeader Header;
+	Header.Width = Width;
+	Header.Height = Height;
+	Header.DepthCodec = DepthCodec;
+	Header.ColorCodec = ColorCodec;
+
+	if (!Write(&Header, sizeof(Header)))
+	{
+		Sink = nullptr;
+		return false;
+	}
+	return true;
+}
+
+bool FPointCloudVideoWriter::WriteFrame(uint64 Timestamp, const uint16* Depth, const uint32* Color)
+{
+	if (!Sink || bFailed) return false;
+
+	if (!Codec.EncodeDepth(DepthCodec, Depth, Width * Height, DepthData)
+		|| !Codec.EncodeColor(ColorCodec, Color, Width, Height, ColorQuality, ColorData))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[Point Cloud Video] Unable to encode frame %d."), Index.Num());
+		return false;
+	}
+
+	FPointCloudVideoFrameHeader FrameHeader;
+	FrameHeader.Timestamp = Timestamp;
+	FrameHeader.DepthSize = DepthData.Num();
+	FrameHeader.ColorSize = ColorData.Num();
+
+	const int64 FrameOffset = Offset;
+	if (!Write(&FrameHeader, sizeof(FrameHeader))
+		|| !Write(DepthData.GetData(), DepthData.Num())
+		|| !Write(ColorData.GetData(), ColorData.Num()))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[Point Cloud Video] Write failed at frame %d, no further frames are written."), Index.Num());
+		return false;
+	}
+
+	// The index only references complete frames
+	Index.Add({ Timestamp, (uint64)FrameOffset, FrameHeader.DepthSize, FrameHeader.ColorSize });
+	return true;
+}
+
+bool FPointCloudVideoWriter::Close()
+{
+	if (!Sink) return false;
+
+	FPointCloudVideoTrailer Trailer;
+	Trailer.IndexOffset = Offset;
+	Trailer.NumFrames = Index.Num();
+	Trailer.Magic = POINTCLOUD_VIDEO_MAGIC;
+
+	// After a failed write the offsets are unknown, leave the file to recovery by scanning
+	const bool bWritten = !bFailed
+		&& Write(Index.GetData(), Index.Num() * sizeof(FPointCloudVideoIndexEntry))
+		&& Write(&Trailer, sizeof(Trailer));
+	const bool bFlushed = Sink->Flush();
+
+	Sink = nullptr;
+	OwnedSink.Reset();
+	Index.Empty();
+	Offset = 0;
+	return bWritten && bFlushed;
+}
+
+bool FPointCloudVideoWriter::Write(const void* Data, int64 Size)
+{
+	if (bFailed) return false;
+	if (Size > 0 && !Sink->Write(Data, Size))
+	{
+		bFailed = true;
+		return false;
+	}
+	Offset += Size;
+	return true;
+}
@@ -0,0 +1,68 @@
+#include "RVLCodec.h"
+
+namespace {
+    struct Reader {
+        const unsigned char *data;
+        const unsigned char *end;
+        unsigned int word = 0;
+        int nibbles = 0;
+        bool failed = false;
+
+        Reader(const unsigned char *_data, size_t size) noexcept : data(_data), end(_data + size) {}
+
+        unsigned int get() noexcept {
+            unsigned int value = 0;
+            unsigned int nibble = 0;
+            int count = 0;
+            do {
+                // Longer than anything the encoder writes, or past the end of the data
+                if (count == RVL::MaxNibblesPerValue || (nibbles == 0 && (size_t)(end - data) < sizeof(word))) {
+                    failed = true;
+                    return 0;
+                }
+                if (nibbles == 0) {
+                    memcpy(&word, data, sizeof(word));
+                    data += sizeof(word);
+                    nibbles = 8;
+                }
+
+                nibble = word >> 28;
+                word <<= 4;
+                --nibbles;
+
+                value |= (nibble & 0x7) << (3 * count);
+                ++count;
+            } while (nibble & 0x8);
+            return value;
+        }
+    };
+}
+
+bool RVL::decode(const unsigned char *data, size_t size, unsigned short *outDepth, size_t numPixels) noexcept {
+    Reader reader(data, size);
+    size_t remaining = numPixels;
+    // Unsigned so corrupt deltas wrap instead of overflowing, only the low 16 bits are kept
+    unsigned int previous = 0;
+
+    while (remaining > 0) {
+        const size_t zeros = reader.get();
+        const size_t nonZeros = reader.get();
+        if (reader.failed || zeros > remaining || nonZeros > remaining - zeros || zeros + nonZeros == 0)
+            return false;
+
+        memset(outDepth, 0, zeros * sizeof(unsigned short));
+        outDepth += zeros;
+
+        for (size_t i = 0; i < nonZeros; ++i) {
+            const unsigned int positive = reader.get();
+            previous += (positive >> 1) ^ (0u - (positive & 1));
+            *outDepth++ = (unsigned short)previous;
+        }
+
+        if (reader.failed)
+            return false;
+        remaining -= zeros + nonZeros;
+    }
+
+    return true;
+}
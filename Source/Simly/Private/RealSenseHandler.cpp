@@ -1,8 +1,13 @@
 #include "RealSenseHandler.h"
+#include "Async/ParallelFor.h"
+
+#include <librealsense2/rsutil.h>
 
 DEFINE_LOG_CATEGORY(LogPointCloud);
 
 #define MAX_BUFFER_U16 0xFFFF
+#define CAPTURE_WAIT_MS 100
+#define VOXEL_BOUNDS_MARGIN 100.0f
 
 inline float GetDepthScale(rs2::device dev) {
 	for (auto& sensor : dev.query_sensors()) {
@@ -31,6 +36,13 @@ void ARealSenseHandler::BeginPlay()
 	Start();
 }
 
+void ARealSenseHandler::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	Stop();
+
+	Super::EndPlay(EndPlayReason);
+}
+
 bool ARealSenseHandler::Start()
 {
 	try
@@ -94,25 +106,29 @@ bool ARealSenseHandler::Start()
 
 		FlushRenderingCommands();
 
-		// Init Pointcloud
-		for (int i = 0; i < DepthConfig.Width * DepthConfig.Height; ++i) 
-			this->Points.Add(FLidarPointCloudPoint(0, 0, -10 * i, 0, 0, 0));
-
-		// Set bounds with some fake points to prevent corruption
-		this->Points[0] = FLidarPointCloudPoint(10000, 0, 0, 0, 0, 0);
-		this->Points[1] = FLidarPointCloudPoint(0, 10000, 0, 0, 0, 0);
-		this->Points[2] = FLidarPointCloudPoint(0, 0, 10000, 0, 0, 0);
-		this->Points[3] = FLidarPointCloudPoint(-10000, 0, 0, 0, 0, 0);
-		this->Points[4] = FLidarPointCloudPoint(0, -10000, 0, 0, 0, 0);
-		this->Points[5] = FLidarPointCloudPoint(0, 0, -10000, 0, 0, 0);
-
-		// Initialize
-		this->PointCloud->SetData(Points);
+		// Init Pointcloud, the cloud bounds grow with the first frames
+		this->Points.Reset();
+		PointsBounds = FBox(ForceInit);
+		CloudBounds = FBox(ForceInit);
+		DensePoints.Reset();
+		DenseVersion = 0;
+		Converter.ResetTiles();
+		Converter.SetDeprojection(nullptr);
+		FPointCloudConverter::Upload(PointCloud, Points, LidarPoints, PointsBounds, CloudBounds);
 
 		// Clear Pipeline
 		RsPipeline.Reset(new rs2::pipeline());
 		rs2::pipeline_profile RsProfile = RsPipeline->start(RsConfig);
 		StartedFlag = true;
+
+		// Initialize capture thread
+		if (bUseCaptureThread)
+		{
+			Worker.Reset(new FRealSenseHandlerWorker(this));
+			FString ThreadName(FString::Printf(TEXT("FRealSenseHandlerWorker_%s"), *FGuid::NewGuid().ToString()));
+			Thread.Reset(FRunnableThread::Create(Worker.Get(), *ThreadName, 0, TPri_AboveNormal));
+			if (!Thread.Get()) throw std::runtime_error("Unable to create capture thread");
+		}
 	}
 	catch (const rs2::error & ex)
 	{
@@ -143,6 +159,16 @@ void ARealSenseHandler::Stop()
 
 		StartedFlag = false;
 
+		// The capture thread must be done with the pipeline before it is stopped
+		if (Thread.Get())
+		{
+			Thread->WaitForCompletion();
+			Thread.Reset();
+		}
+		Worker.Reset();
+
+		Recorder.Close();
+
 		if (RsPipeline.Get())
 		{
 			try {
@@ -176,14 +202,34 @@ void ARealSenseHandler::Stop()
 void ARealSenseHandler::Tick(float DeltaSeconds)
 {
 	Super::Tick(DeltaSeconds);
+
+	if (bUpdateOnTick && Thread.Get())
+	{
+		PollFrame(FTransform(), false);
+	}
 }
 
 void ARealSenseHandler::PollFrame(FTransform Transform = FTransform(), bool Append = false)
 {
+	if (Thread.Get())
+	{
+		// The capture thread clips like ProcessFrameset would, from the next frame it converts
+		bCaptureClipDepth.AtomicSet(ShouldClipDepth(Append));
+
+		if (!CapturedFrames.IsDirty()) return;
+
+		// Take the newest frame and hand the previous point array back to the capture thread
+		CapturedFrames.SwapReadBuffers();
+		Exchange(Points, CapturedFrames.Read().Points);
+		PointsBounds = CapturedFrames.Read().Bounds;
+		UploadPoints(Transform, Append);
+		return;
+	}
+
 	rs2::frameset Frameset;
 	try
 	{
-		RsPipeline->poll_for_frames(&Frameset);
+		if (!RsPipeline.Get() || !RsPipeline->poll_for_frames(&Frameset)) return;
 		ProcessFrameset(&Frameset, Transform, Append);
 	}
 	catch (const rs2::error & ex)
@@ -192,72 +238,229 @@ void ARealSenseHandler::PollFrame(FTransform Transform = FTransform(), bool Appe
 	}
 }
 
+void ARealSenseHandler::ThreadProc()
+{
+	while (StartedFlag)
+	{
+		try
+		{
+			rs2::frameset Frameset;
+			if (!RsPipeline->try_wait_for_frames(&Frameset, CAPTURE_WAIT_MS)) continue;
+
+			// Clipped the way the last PollFrame asked for. Frames without changes are not published,
+			// so PollFrame has nothing to upload
+			FRealSenseCapturedFrame& Frame = CapturedFrames.GetWriteBuffer();
+			if (ConvertFrameset(&Frameset, Frame.Points, Frame.Bounds, bCaptureClipDepth))
+			{
+				CapturedFrames.SwapWriteBuffers();
+			}
+			FramesetId++;
+		}
+		catch (const rs2::error & ex)
+		{
+			UE_LOG(LogPointCloud, Error, TEXT("ARealSenseHandler::ThreadProc exception: %s"), ANSI_TO_TCHAR(ex.what()));
+		}
+	}
+}
+
 void ARealSenseHandler::ProcessFrameset(rs2::frameset* Frameset, FTransform Transform, bool Append)
+{
+	if (!ConvertFrameset(Frameset, Points, PointsBounds, ShouldClipDepth(Append)) && !Append) return;
+	UploadPoints(Transform, Append);
+	FramesetId++;
+}
+
+bool ARealSenseHandler::ShouldClipDepth(bool Append) const
+{
+	// Appending every pixel keeps the out of range ones too, the voxel grid only merges clipped points
+	return !Append || bUseVoxelGrid;
+}
+
+bool ARealSenseHandler::ConvertFrameset(rs2::frameset* Frameset, FPointCloudBuffer& OutPoints, FBox& OutBounds, bool bClipDepth)
 {
 	const rs2::video_frame& DepthFrame = (RsAlign.Get()) ? RsAlign->process(*Frameset).get_depth_frame() : Frameset->get_depth_frame();
 	const rs2::video_frame& ColorFrame = Frameset->get_color_frame();
 
-	const auto width = DepthFrame.get_width();
-	const auto height = DepthFrame.get_height();
+	FDepthConversionParams Params;
+	Params.Width = DepthFrame.get_width();
+	Params.Height = DepthFrame.get_height();
+	Params.DepthScale = DepthScale;
+	Params.ScaleX = ScaleX;
+	Params.ScaleY = ScaleY;
+	Params.DepthMin = DepthMin;
+	Params.DepthMax = DepthMax;
+	Params.bClipDepth = bClipDepth;
+	Params.NumWorkers = ConversionWorkers;
+	Params.DirtyDepthThreshold = DirtyDepthThreshold;
+	Params.DirtyColorThreshold = DirtyColorThreshold;
+	Params.Decimation = Decimation;
+	Params.DecimationFactor = DecimationFactor;
+	Params.PointBudget = PointBudget;
+
+	// Rays from the intrinsics of the frame being converted, the color stream's once aligned.
+	// The converter only rebuilds its ray table when they change
+	if (bUseStreamIntrinsics)
+	{
+		const rs2_intrinsics Intrinsics = DepthFrame.get_profile().as<rs2::video_stream_profile>().get_intrinsics();
+		if (!Converter.HasDeprojection() || FMemory::Memcmp(&Intrinsics, &DepthIntrinsics, sizeof(rs2_intrinsics)) != 0)
+		{
+			DepthIntrinsics = Intrinsics;
+			Converter.SetDeprojection([Intrinsics](float U, float V, float& OutX, float& OutY)
+			{
+				const float Pixel[2] = { U, V };
+				float Point[3];
+				rs2_deproject_pixel_to_point(Point, &Intrinsics, Pixel, 1.0f);
+				OutX = Point[0];
+				OutY = Point[1];
+			});
+		}
+	}
+	else if (Converter.HasDeprojection())
+	{
+		Converter.SetDeprojection(nullptr);
+	}
 
-	const int centerx = 0.5 * width;
-	const int centery = 0.5 * height;
+	const uint16* Depth = (const uint16*)DepthFrame.get_data();
+	const uint32* Color = (const uint32*)ColorFrame.get_data();
 
-	const uint16_t* depth_data = (const uint16_t*)DepthFrame.get_data();
-	const rgba* color_data = (const rgba*)ColorFrame.get_data();
-	
-	for (int i = 0; i < width * height; ++i)
+	if (Recorder.IsRecording())
 	{
-		const uint16_t depth = depth_data[i];
-		const rgba color = color_data[i];
+		Recorder.SubmitFrame((uint64)DepthFrame.get_timestamp(), Params.Width, Params.Height, Depth, Color);
+	}
 
-		float z = depth * DepthScale;
-		float x = ((i % width) - centerx - 0.5f) * z * ScaleX;
-		float y = ((i / width) - centery - 0.5f) * z * ScaleY;
+	Params = Converter.Decimate(Params, Depth, Color);
 
-		if (Append)
-		{
-			FVector Local = FVector(-x, -z, -y);
-			FVector World = Transform.TransformPosition(Local);
-			this->Points[i].Location = World;
-			this->Points[i].Color.R = color.r;
-			this->Points[i].Color.G = color.g;
-			this->Points[i].Color.B = color.b;
-		}
-		else
+	// Invalid pixels are dropped here, nothing downstream sees them
+	if (bIncrementalUpdate)
+	{
+		if (!Converter.ConvertIncremental(Params, Depth, Color, DensePoints, DenseVersion)) return false;
+		Converter.Compact(Params, DensePoints, OutPoints, OutBounds);
+		return true;
+	}
+
+	Converter.ConvertCompact(Params, Depth, Color, OutPoints, OutBounds);
+	return true;
+}
+
+void ARealSenseHandler::UploadPoints(FTransform Transform, bool Append)
+{
+	if (Append && bUseVoxelGrid)
+	{
+		if (VoxelSize != Voxels.GetVoxelSize())
 		{
-			if (z < this->DepthMin || z > this->DepthMax)
-			{
-				this->Points[i].Location.Set(0, 0, 0);
-				this->Points[i].Color.R = 0;
-				this->Points[i].Color.G = 0;
-				this->Points[i].Color.B = 0;
-			}
-			else
-			{
-				this->Points[i].Location.Set(-x, -z, -y);
-				this->Points[i].Color.R = color.r;
-				this->Points[i].Color.G = color.g;
-				this->Points[i].Color.B = color.b;
-			}
+			ClearVoxels();
+			Voxels.SetVoxelSize(VoxelSize);
 		}
+
+		Voxels.AddPoints(Points, Transform);
+		if (Voxels.NumPending() >= VoxelBatchSize || IsVoxelRefreshDue()) FlushVoxels();
+
+		this->FirstFrame = false;
+		return;
 	}
 
-	if (!Append) PointCloud->SetData(Points);
+	if (!Append) FPointCloudConverter::Upload(PointCloud, Points, LidarPoints, PointsBounds, CloudBounds);
 	else
 	{
+		// Transformed on the way out, Points stays in camera space for the next unchanged frame
+		Points.ToLidarPoints(LidarPoints, Transform);
+
 		if (this->FirstFrame)
 		{
 			FBox Bounds = FBox();
 			Bounds.ExpandBy(FVector(-10000, -10000, -10000), FVector(10000, 10000, 1000));
 			PointCloud->Initialize(Bounds);
+
+			// Upload reuses the octree while its bounds hold, make it build a fresh one after this
+			CloudBounds = FBox(ForceInit);
 		}
-		PointCloud->InsertPoints(Points, ELidarPointCloudDuplicateHandling::SelectFirst, false, FVector(0, 0, 0));
+		PointCloud->InsertPoints(LidarPoints, ELidarPointCloudDuplicateHandling::SelectFirst, false, FVector(0, 0, 0));
 		PointCloud->RefreshRendering();
 	}
 	
 	this->FirstFrame = false;
-	FramesetId++;
+}
+
+bool ARealSenseHandler::IsVoxelRefreshDue() const
+{
+	return VoxelRefreshInterval > 0.0f && Voxels.NumUpdated() > 0 && FPlatformTime::Seconds() - LastVoxelRefresh >= VoxelRefreshInterval;
+}
+
+void ARealSenseHandler::FlushVoxels()
+{
+	const bool bRefresh = IsVoxelRefreshDue();
+	if (Voxels.NumPending() == 0 && !bRefresh) return;
+
+	const bool bGrown = !VoxelCloudBounds.IsValid || !VoxelCloudBounds.IsInside(Voxels.GetBounds());
+	if (!bGrown && !bRefresh)
+	{
+		Voxels.ConsumePending(VoxelPoints);
+	}
+	else
+	{
+		// The cloud can't replace a point in place, so updated voxels are refreshed by rebuilding it.
+		// When it grew past its bounds, rebuild with twice the scanned size so an expanding scan rarely rebuilds
+		if (bGrown)
+		{
+			const FBox& Bounds = Voxels.GetBounds();
+			VoxelCloudBounds = Bounds.ExpandBy(Bounds.GetExtent() + FVector(VOXEL_BOUNDS_MARGIN));
+		}
+		PointCloud->Initialize(VoxelCloudBounds);
+		CloudBounds = FBox(ForceInit);
+		Voxels.GetAllPoints(VoxelPoints);
+		LastVoxelRefresh = FPlatformTime::Seconds();
+	}
+
+	PointCloud->InsertPoints(VoxelPoints, ELidarPointCloudDuplicateHandling::SelectFirst, false, FVector(0, 0, 0));
+	PointCloud->RefreshRendering();
+}
+
+void ARealSenseHandler::ClearVoxels()
+{
+	Voxels.Reset();
+	VoxelPoints.Empty();
+
+	// Next flush starts a new cloud
+	VoxelCloudBounds = FBox(ForceInit);
+}
+
+TArray<FLidarPointCloudPoint> ARealSenseHandler::GetPoints() const
+{
+	TArray<FLidarPointCloudPoint> Result;
+	Points.ToLidarPoints(Result);
+	return Result;
+}
+
+int32 ARealSenseHandler::GetNumPoints() const
+{
+	return Points.Num();
+}
+
+int32 ARealSenseHandler::GetNumVoxels() const
+{
+	return Voxels.NumVoxels();
+}
+
+bool ARealSenseHandler::StartRecording(FString FileName)
+{
+	const EPointCloudVideoCodec DepthCodec = bCompressRecording ? EPointCloudVideoCodec::RVL : EPointCloudVideoCodec::Raw;
+	const EPointCloudVideoCodec ColorCodec = bCompressRecording ? EPointCloudVideoCodec::Jpeg : EPointCloudVideoCodec::Raw;
+	return Recorder.Open(FileName, DepthCodec, ColorCodec, RecordingQuality);
+}
+
+void ARealSenseHandler::StopRecording()
+{
+	Recorder.Close();
+}
+
+int32 ARealSenseHandler::GetRecordedFrames() const
+{
+	return Recorder.GetRecordedFrames();
+}
+
+int32 ARealSenseHandler::GetDroppedRecordingFrames() const
+{
+	return Recorder.GetDroppedFrames();
 }
 
 void ARealSenseHandler::SavePointCloud()
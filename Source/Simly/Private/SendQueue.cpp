@@ -0,0 +1,76 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "SendQueue.h"
+#include "SocketPoller.h"
+
+FSendQueue::FSendQueue(int32 InCapacity)
+{
+	const int32 Capacity = FMath::RoundUpToPowerOfTwo(FMath::Max(InCapacity, 256));
+	Ring.SetNumUninitialized(Capacity);
+	Mask = Capacity - 1;
+}
+
+bool FSendQueue::Enqueue(const uint8* Data, int32 Length, bool& bOutWasEmpty)
+{
+	FScopeLock Lock(&Mx);
+
+	bOutWasEmpty = (Head == Tail);
+	if (Tail - Head + Length > (uint64) Ring.Num())
+	{
+		DroppedPackets.Increment();
+		return false;
+	}
+
+	// Copy in at most two pieces around the wrap point
+	const int32 Start = (int32)(Tail & Mask);
+	const int32 First = FMath::Min(Length, Ring.Num() - Start);
+	FMemory::Memcpy(Ring.GetData() + Start, Data, First);
+	FMemory::Memcpy(Ring.GetData(), Data + First, Length - First);
+	Tail += Length;
+	return true;
+}
+
+bool FSendQueue::Flush(FSocket* Socket)
+{
+	uint64 FlushHead, FlushTail;
+	{
+		FScopeLock Lock(&Mx);
+		FlushHead = Head;
+		FlushTail = Tail;
+	}
+
+	if (FlushHead == FlushTail)
+	{
+		return true;
+	}
+
+	// Producers only write past Tail, so the snapshot can be sent without holding the lock
+	const int32 Start = (int32)(FlushHead & Mask);
+	const int32 Pending = (int32)(FlushTail - FlushHead);
+	const int32 First = FMath::Min(Pending, Ring.Num() - Start);
+
+	int32 BytesSent = 0;
+	const bool bSuccess = FSocketPoller::SendGather(Socket, Ring.GetData() + Start, First, Ring.GetData(), Pending - First, BytesSent);
+
+	FScopeLock Lock(&Mx);
+	Head += BytesSent;
+	return bSuccess;
+}
+
+bool FSendQueue::IsEmpty() const
+{
+	FScopeLock Lock(&Mx);
+	return Head == Tail;
+}
+
+int32 FSendQueue::Num() const
+{
+	FScopeLock Lock(&Mx);
+	return (int32)(Tail - Head);
+}
@@ -0,0 +1,142 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "SensorTable.h"
+
+// Keeps UIDs positive, Generation * MaxDevices + Slot
+#define MAX_SLOT_GENERATION (MAX_int32 / FSensorTable::MaxDevices - 1)
+
+// Marks a slot one thread is registering into, negative so FindSlot never matches it
+#define CLAIMING_UID -2
+
+int32 FSensorTable::Register()
+{
+	for (int32 Index = 0; Index < MaxDevices; ++Index)
+	{
+		FSlot& Slot = Slots[Index];
+
+		// The accept and UDP threads both register, only one of them may own the slot's writes
+		int32 Expected = INDEX_NONE;
+		if (!Slot.Uid.compare_exchange_strong(Expected, CLAIMING_UID, std::memory_order_acquire, std::memory_order_relaxed)) continue;
+
+		// Clear what the previous device left behind before the new UID becomes visible
+		BeginWrite(Slot);
+		Slot.Values = FValues();
+		Slot.Generation = Slot.Generation < MAX_SLOT_GENERATION ? Slot.Generation + 1 : 0;
+		const int32 Uid = Slot.Generation * MaxDevices + Index;
+		Slot.Uid.store(Uid, std::memory_order_release);
+		EndWrite(Slot);
+		return Uid;
+	}
+	return INDEX_NONE;
+}
+
+void FSensorTable::Unregister(int32 Uid)
+{
+	if (FSlot* Slot = FindSlot(Uid))
+	{
+		BeginWrite(*Slot);
+		Slot->Values = FValues();
+		EndWrite(*Slot);
+
+		// Freed only after the last write, Register may start writing to the slot right away
+		Slot->Uid.store(INDEX_NONE, std::memory_order_release);
+	}
+}
+
+void FSensorTable::WriteForce(int32 Uid, const FForceSensor& Force)
+{
+	if (FSlot* Slot = FindSlot(Uid))
+	{
+		BeginWrite(*Slot);
+		Slot->Values.Force = Force;
+		Slot->Values.bHasForce = true;
+		EndWrite(*Slot);
+	}
+}
+
+void FSensorTable::WriteRotation(int32 Uid, const FRotatorSensor& Rotation)
+{
+	if (FSlot* Slot = FindSlot(Uid))
+	{
+		BeginWrite(*Slot);
+		Slot->Values.Rotation = Rotation;
+		Slot->Values.bHasRotation = true;
+		EndWrite(*Slot);
+	}
+}
+
+bool FSensorTable::GetLatestForce(int32 Uid, FForceSensor& OutForce) const
+{
+	const FSlot* Slot = FindSlot(Uid);
+	FValues Values;
+	if (!Slot || !Read(*Slot, Uid, Values) || !Values.bHasForce) return false;
+
+	OutForce = Values.Force;
+	return true;
+}
+
+bool FSensorTable::GetLatestRotation(int32 Uid, FRotatorSensor& OutRotation) const
+{
+	const FSlot* Slot = FindSlot(Uid);
+	FValues Values;
+	if (!Slot || !Read(*Slot, Uid, Values) || !Values.bHasRotation) return false;
+
+	OutRotation = Values.Rotation;
+	return true;
+}
+
+FSensorTable::FSlot* FSensorTable::FindSlot(int32 Uid)
+{
+	if (Uid < 0) return nullptr;
+	FSlot& Slot = Slots[Uid % MaxDevices];
+	return Slot.Uid.load(std::memory_order_relaxed) == Uid ? &Slot : nullptr;
+}
+
+const FSensorTable::FSlot* FSensorTable::FindSlot(int32 Uid) const
+{
+	// Readers check the UID again inside the seqlock, this only rejects UIDs that are obviously gone
+	if (Uid < 0) return nullptr;
+	const FSlot& Slot = Slots[Uid % MaxDevices];
+	return Slot.Uid.load(std::memory_order_relaxed) == Uid ? &Slot : nullptr;
+}
+
+void FSensorTable::BeginWrite(FSlot& Slot)
+{
+	Slot.Sequence.store(Slot.Sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+}
+
+void FSensorTable::EndWrite(FSlot& Slot)
+{
+	Slot.Sequence.store(Slot.Sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+bool FSensorTable::Read(const FSlot& Slot, int32 Uid, FValues& OutValues)
+{
+	while (true)
+	{
+		const uint32 Before = Slot.Sequence.load(std::memory_order_acquire);
+		if (Before & 1)
+		{
+			// Writer is in the middle of an update, it only copies a few bytes
+			FPlatformProcess::Sleep(0.0f);
+			continue;
+		}
+
+		const int32 SlotUid = Slot.Uid.load(std::memory_order_relaxed);
+		OutValues = Slot.Values;
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (Slot.Sequence.load(std::memory_order_relaxed) == Before)
+		{
+			return SlotUid == Uid;
+		}
+	}
+}
@@ -9,11 +9,52 @@
 #include "ServerSocket.h"
 #include "Async/Async.h"
 #include "Buffer.h"
+#include "SimlyProtocol.h"
 #include "SocketSubsystem.h"
 #include "Kismet/KismetSystemLibrary.h"
 
 DEFINE_LOG_CATEGORY(LogServer);
 
+// Upper bound for NumIOWorkers = 0, sensor traffic rarely needs more
+#define MAX_AUTO_IO_WORKERS 8
+
+// Datagram ingest
+#define MAX_DATAGRAM_SIZE 65507
+#define UDP_RECEIVE_BUFFER_SIZE (1024 * 1024)
+#define UDP_WAIT_MS 100
+#define UDP_REORDER_WINDOW 1024
+
+// Smallest sensor history, batched force samples go through it even with SensorHistorySize = 0
+#define MIN_SENSOR_HISTORY_SIZE 4096
+
+// Latencies kept per transport for the percentiles
+#define LATENCY_HISTORY_SIZE 4096
+
+void FLatencyHistory::Add(float Ms)
+{
+	if (Samples.Num() < LATENCY_HISTORY_SIZE) Samples.Add(Ms);
+	else Samples[Next] = Ms;
+	Next = (Next + 1) % LATENCY_HISTORY_SIZE;
+	Events++;
+}
+
+float FLatencyHistory::GetPercentile(float Percentile) const
+{
+	if (Samples.Num() == 0) return 0.0f;
+
+	TArray<float> Sorted = Samples;
+	Sorted.Sort();
+	const int32 Index = FMath::Clamp(FMath::CeilToInt(Percentile * Sorted.Num()) - 1, 0, Sorted.Num() - 1);
+	return Sorted[Index];
+}
+
+void FLatencyHistory::Reset()
+{
+	Samples.Reset();
+	Next = 0;
+	Events = 0;
+}
+
 UServerSocket::UServerSocket(const FObjectInitializer& init) : UActorComponent(init)
 {
 	bShouldAutoListen = true;
@@ -26,7 +67,15 @@ UServerSocket::UServerSocket(const FObjectInitializer& init) : UActorComponent(i
 	bShouldPing = false;
 	PingInterval = 10.0f;
 	PingMessage = TEXT("<Ping>");
-	BufferMaxSize = 2048;
+	SendQueueSize = 64 * 1024;
+	NumIOWorkers = 0;
+	bListenUdp = false;
+	UdpPort = 0;
+	UdpPeerTimeout = 10.0f;
+	UdpSocket = nullptr;
+	SensorHistorySize = 0;
+	BufferMaxSize = 0;
+	PrimaryComponentTick.bCanEverTick = true;
 }
 
 void UServerSocket::StartListenServer(const int32 InListenPort)
@@ -38,26 +87,82 @@ void UServerSocket::StartListenServer(const int32 InListenPort)
 	FIPv4Endpoint Endpoint(Address, InListenPort);
 
 	ListenSocket = FTcpSocketBuilder(*ListenSocketName)
-		//.AsNonBlocking()
+		.AsNonBlocking()
 		.AsReusable()
-		.BoundToEndpoint(Endpoint)
-		.WithReceiveBufferSize(BufferMaxSize);
+		.BoundToEndpoint(Endpoint);
+
+	// Deprecated BufferMaxSize, still set by older assets and Blueprints
+	if (BufferMaxSize > 0)
+	{
+		if (SocketOptions.ReceiveBufferSize == 0) SocketOptions.ReceiveBufferSize = BufferMaxSize;
+		if (SocketOptions.SendBufferSize == 0) SocketOptions.SendBufferSize = BufferMaxSize;
+	}
+
+	// Buffer sizes have to be set before listening for the TCP window scale to pick them up
+	if (!SimlySocketOptions::Apply(ListenSocket, SocketOptions))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[ServerSocket] Some socket options were not applied to the listen socket."));
+	}
 
-	ListenSocket->SetReceiveBufferSize(BufferMaxSize, BufferMaxSize);
-	ListenSocket->SetSendBufferSize(BufferMaxSize, BufferMaxSize);
+	ListenSocket->Listen(FMath::Max(SocketOptions.ListenBacklog, 1));
 
-	ListenSocket->Listen(8);
+	// Accept path, only waits on the listen socket
+	Poller.Reset(new FSocketPoller());
+	if (!Poller->IsValid() || !Poller->Add(ListenSocket, nullptr, ESocketPollFlags::Readable))
+	{
+		UE_LOG(LogTemp, Error, TEXT("[ServerSocket] Unable to create socket poller."));
+		Poller.Reset();
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(ListenSocket);
+		ListenSocket = nullptr;
+		return;
+	}
+
+	// Client I/O, every client stays on the worker it was assigned to
+	const int32 NumWorkers = NumIOWorkers > 0 ? NumIOWorkers : FMath::Clamp(FPlatformMisc::NumberOfCores() / 2, 1, MAX_AUTO_IO_WORKERS);
+	for (int32 i = 0; i < NumWorkers; ++i)
+	{
+		TUniquePtr<FServerShard> Shard(new FServerShard());
+		Shard->Poller.Reset(new FSocketPoller());
+		if (!Shard->Poller->IsValid())
+		{
+			UE_LOG(LogTemp, Error, TEXT("[ServerSocket] Unable to create socket poller for I/O worker %d."), i);
+			continue;
+		}
+		Shards.Add(MoveTemp(Shard));
+	}
+
+	if (Shards.Num() == 0)
+	{
+		Poller.Reset();
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(ListenSocket);
+		ListenSocket = nullptr;
+		return;
+	}
 
 	OnListenBegin.Broadcast();
 	bShouldListen = true;
+	bShouldServe = true;
+
+	for (const TUniquePtr<FServerShard>& Shard : Shards)
+	{
+		FServerShard* ShardPtr = Shard.Get();
+		Shard->Finished = UServerSocket::RunLambdaOnBackGroundThread([this, ShardPtr]()
+		{
+			RunShard(*ShardPtr);
+		});
+	}
 
-	UE_LOG(LogTemp, Log, TEXT("[ServerSocket] Listening on port: %d"), (int) InListenPort);
+	if (bListenUdp)
+	{
+		StartUdpListener(UdpPort > 0 ? UdpPort : InListenPort);
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("[ServerSocket] Listening on port: %d with %d I/O workers"), (int) InListenPort, Shards.Num());
 	ServerFinishedFuture = UServerSocket::RunLambdaOnBackGroundThread([&]()
 	{
-		TArray<uint8> ReceiveBuffer;
-		TArray<TSharedPtr<ClientSocket>> ClientsDisconnected;
+		TArray<FSocketPollEvent> Events;
 
-		UE_LOG(LogTemp, Log, TEXT("[ServerSocket] Worker thread started."));
+		UE_LOG(LogTemp, Log, TEXT("[ServerSocket] Accept thread started."));
 
 		while (bShouldListen)
 		{
@@ -69,148 +174,481 @@ void UServerSocket::StartListenServer(const int32 InListenPort)
 			}
 
 			//Do we have clients trying to connect? connect them
-			bool bHasPendingConnection;
-			ListenSocket->HasPendingConnection(bHasPendingConnection);
-			if (bHasPendingConnection)
+			if (Poller->Wait(Events, FTimespan::FromSeconds(1.0)) > 0)
 			{
-				UE_LOG(LogTemp, Log, TEXT("[ServerSocket] Processing pending clients."));
-				TSharedPtr<FInternetAddr> Addr = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateInternetAddr();
-				FSocket* Socket = ListenSocket->Accept(*Addr, TEXT("tcp-client"));
-
-				const FString AddressString = Addr->ToString(true);
-				
-				TSharedPtr<ClientSocket> Client = MakeShareable(new ClientSocket());
-				Client->Address = AddressString;
-				Client->Socket = Socket;
-				Client->LastPing = FDateTime::Now();
-				Client->PingNum = -1;
-
-				Clients.Add(AddressString, Client);	//todo: balance this with remove when clients disconnect
-				UE_LOG(LogTemp, Log, TEXT("[ServerSocket] New client connected: %s."), *Client->Address);
-
-				AsyncTask(ENamedThreads::GameThread, [&, AddressString]()
-				{
-					OnClientConnected.Broadcast(AddressString);
-				});
+				AcceptPendingClients();
 			}
+		}//end while
+
+		//Server ended
+		AsyncTask(ENamedThreads::GameThread, [&]()
+		{
+			OnListenEnd.Broadcast();
+		});
+	});
+}
 
-			//Check each endpoint for data
-			for (auto ClientPair : Clients)
+void UServerSocket::RunShard(FServerShard& Shard)
+{
+	TArray<FSocketPollEvent> Events;
+	TArray<FString> ClientsDisconnected;
+	FTimespan PingWait = FTimespan::FromSeconds(1.0);
+
+	while (bShouldServe)
+	{
+		// Sleep until a socket is ready, we get woken up or the next ping is due
+		Shard.Poller->Wait(Events, bShouldPing ? PingWait : FTimespan::FromSeconds(1.0));
+
+		//Take over clients the accept thread assigned to us
+		TSharedPtr<ClientSocket, ESPMode::ThreadSafe> Added;
+		while (Shard.PendingAdds.Dequeue(Added))
+		{
+			Shard.Clients.Add(Added);
+			if (!Shard.Poller->Add(Added->Socket, Added.Get(), ESocketPollFlags::Readable))
 			{
-				TSharedPtr<ClientSocket> Client = ClientPair.Value;
+				ClientsDisconnected.AddUnique(Added->Address);
+			}
+		}
 
-				// Catch access violation if client got disposed on main thread
-				if (!Client.IsValid() || Client->Socket == nullptr)
-				{
-					ClientsDisconnected.Add(Client);
-					continue;
-				}
+		for (const FSocketPollEvent& Event : Events)
+		{
+			// Only this thread removes its clients, so the pointer stays valid for the whole iteration
+			ClientSocket* Client = (ClientSocket*) Event.UserData;
 
-				//Did we disconnect? Note that this almost never changed from connected due to engine bug, instead it will be caught when trying to send data
-				ESocketConnectionState ConnectionState = Client->Socket->GetConnectionState();
-				if (ConnectionState != ESocketConnectionState::SCS_Connected)
-				{
-					ClientsDisconnected.Add(Client);
-					continue;
-				}
+			bool bConnected = !EnumHasAnyFlags(Event.Flags, ESocketPollFlags::Closed);
+			if (EnumHasAnyFlags(Event.Flags, ESocketPollFlags::Readable))
+			{
+				bConnected = Client->ReceiveData(this) && bConnected;
+			}
+			if (bConnected && EnumHasAnyFlags(Event.Flags, ESocketPollFlags::Writable))
+			{
+				bConnected = FlushClient(Shard, Client);
+			}
 
-				if (Client->DecodeLen == -1 && Client->Socket->HasPendingData(Client->Header))
-				{
-					int32 Read = 0;
-					ReceiveBuffer.SetNumUninitialized(2);
-					Client->Socket->Recv(ReceiveBuffer.GetData(), ReceiveBuffer.Num(), Read);
-					Client->RecvBuff.writeArray(ReceiveBuffer.GetData(), ReceiveBuffer.Num());
-					Client->DecodeLen = Client->RecvBuff.readInt16_LE();
-					Client->RecvBuff.clear();
-					UE_LOG(LogTemp, Log, TEXT("[ClientSocket] Received Header: %d."), (int)Client->DecodeLen);
-				}
+			if (!bConnected)
+			{
+				ClientsDisconnected.AddUnique(Client->Address);
+			}
+		}
 
-				if (Client->DecodeLen != -1 && Client->Socket->HasPendingData(Client->DecodeLen))
-				{
-					// Read packet data
-					int32 Read = 0;
-					ReceiveBuffer.SetNumUninitialized(Client->DecodeLen);
-					Client->Socket->Recv(ReceiveBuffer.GetData(), ReceiveBuffer.Num(), Read);
-					Client->RecvBuff.writeArray(ReceiveBuffer.GetData(), ReceiveBuffer.Num());
-
-					// Handle packet
-					Client->ProcessPacket(this);
-
-					// Clear buffer
-					Client->DecodeLen = -1;
-					Client->RecvBuff.clear();
-				}
+		if (bShouldPing)
+		{
+			PingWait = RunPingLogic(Shard);
+		}
 
-				if (bShouldPing)
-				{
-					FDateTime Now = FDateTime::Now();
-					float TimeSinceLastPing = (Now - Client->LastPing).GetTotalSeconds();
+		//Send everything that got queued since the last iteration, one write per client
+		TSharedPtr<ClientSocket, ESPMode::ThreadSafe> FlushRequest;
+		while (Shard.PendingFlushes.Dequeue(FlushRequest))
+		{
+			if (FlushRequest->Socket && !FlushClient(Shard, FlushRequest.Get()))
+			{
+				ClientsDisconnected.AddUnique(FlushRequest->Address);
+			}
+		}
 
-					if (TimeSinceLastPing > PingInterval)
-					{
-						UE_LOG(LogTemp, Log, TEXT("[ClientSocket] Running Ping Logic, current num: %d"), (int) Client->PingNum);
-						if (Client->PingNum == -1) {
-							// Last ping attempt was succesfull, send new key
-							UE_LOG(LogTemp, Log, TEXT("[ClientSocket] Sending Ping: %d."), (int)Client->PingKey);
-							Client->PingNum = rand();
-							Client->SendPing();
-						}
-						else
-						{
-							// Previous ping attempt didn't result key in time
-							UE_LOG(LogTemp, Log, TEXT("[ClientSocket] Never got ping! Closing socket.%d."));
-							Client->Socket->Close();
-						}
-						Client->LastPing = Now;
-					}
+		//Handle disconnect requests from other threads
+		FString Requested;
+		while (Shard.PendingDisconnects.Dequeue(Requested))
+		{
+			if (Requested == TEXT("All"))
+			{
+				for (const TSharedPtr<ClientSocket, ESPMode::ThreadSafe>& Client : Shard.Clients)
+				{
+					ClientsDisconnected.AddUnique(Client->Address);
 				}
 			}
+			else
+			{
+				ClientsDisconnected.AddUnique(Requested);
+			}
+		}
 
-			//Handle disconnections
-			if (ClientsDisconnected.Num() > 0)
+		//Handle disconnections
+		if (ClientsDisconnected.Num() > 0)
+		{
+			UE_LOG(LogTemp, Log, TEXT("[ServerSocket] Removing dead cients."));
+			for (const FString& ClientAddress : ClientsDisconnected)
 			{
-				UE_LOG(LogTemp, Log, TEXT("[ServerSocket] Removing dead cients."));
-				for (TSharedPtr<ClientSocket> ClientToRemove : ClientsDisconnected)
+				RemoveClient(Shard, ClientAddress);
+			}
+			ClientsDisconnected.Empty();
+		}
+	}//end while
+
+	//Clients that were assigned but never picked up are closed with the rest
+	TSharedPtr<ClientSocket, ESPMode::ThreadSafe> Added;
+	while (Shard.PendingAdds.Dequeue(Added))
+	{
+		Shard.Clients.Add(Added);
+	}
+
+	for (const TSharedPtr<ClientSocket, ESPMode::ThreadSafe>& Client : Shard.Clients)
+	{
+		{
+			FScopeLock Lock(&ClientsMx);
+			Clients.Remove(Client->Address);
+		}
+		Sensors.Unregister(Client->UID);
+		Shard.Poller->Remove(Client->Socket);
+		Client->Socket->Close();
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(Client->Socket);
+		Client->Socket = nullptr;
+	}
+	Shard.Clients.Empty();
+}
+
+void UServerSocket::AcceptPendingClients()
+{
+	// Listen socket is non-blocking, drain the whole backlog
+	while (true)
+	{
+		TSharedRef<FInternetAddr> Addr = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateInternetAddr();
+		FSocket* Socket = ListenSocket->Accept(*Addr, TEXT("tcp-client"));
+		if (!Socket)
+		{
+			return;
+		}
+
+		const FString AddressString = Addr->ToString(true);
+
+		// The client stays on this worker until it disconnects
+		const int32 ShardIndex = PickShard();
+
+		TSharedPtr<ClientSocket, ESPMode::ThreadSafe> Client = MakeShareable(new ClientSocket(SendQueueSize));
+		Client->Address = AddressString;
+		Client->Socket = Socket;
+		Client->Shard = ShardIndex;
+		Client->UID = Sensors.Register();
+		if (Client->UID == INDEX_NONE)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("[ServerSocket] Sensor table full, %s can only be read through the sensor events."), *AddressString);
+		}
+		Client->LastPing = FDateTime::Now();
+		Client->PingNum = -1;
+
+		Socket->SetNonBlocking(true);
+
+		// Not every platform lets accepted sockets inherit the listen socket's options
+		SimlySocketOptions::Apply(Socket, SocketOptions);
+
+		{
+			FScopeLock Lock(&ClientsMx);
+			Clients.Add(AddressString, Client);
+		}
+		FServerShard& Shard = *Shards[ShardIndex];
+		Shard.NumClients.Increment();
+		Shard.PendingAdds.Enqueue(Client);
+		Shard.Poller->Wakeup();
+		UE_LOG(LogTemp, Log, TEXT("[ServerSocket] New client connected: %s on I/O worker %d."), *Client->Address, ShardIndex);
+
+		AsyncTask(ENamedThreads::GameThread, [&, AddressString]()
+		{
+			OnClientConnected.Broadcast(AddressString);
+		});
+	}
+}
+
+int32 UServerSocket::PickShard() const
+{
+	// Least loaded worker
+	int32 ShardIndex = 0;
+	for (int32 i = 1; i < Shards.Num(); ++i)
+	{
+		if (Shards[i]->NumClients.GetValue() < Shards[ShardIndex]->NumClients.GetValue())
+		{
+			ShardIndex = i;
+		}
+	}
+	return ShardIndex;
+}
+
+bool UServerSocket::StartUdpListener(int32 Port)
+{
+	FIPv4Endpoint Endpoint(FIPv4Address::Any, Port);
+	UdpSocket = FUdpSocketBuilder(*(ListenSocketName + TEXT("-udp")))
+		.AsNonBlocking()
+		.AsReusable()
+		.BoundToEndpoint(Endpoint)
+		.WithReceiveBufferSize(UDP_RECEIVE_BUFFER_SIZE)
+		.Build();
+
+	if (!UdpSocket)
+	{
+		UE_LOG(LogTemp, Error, TEXT("[ServerSocket] Unable to bind UDP port %d."), Port);
+		return false;
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("[ServerSocket] Listening for datagrams on port: %d"), Port);
+	UdpFinishedFuture = UServerSocket::RunLambdaOnBackGroundThread([this]()
+	{
+		RunUdpListener();
+	});
+	return true;
+}
+
+void UServerSocket::RunUdpListener()
+{
+	// UDP devices are known by their source address, IPv4 + port
+	TMap<uint64, TSharedPtr<ClientSocket, ESPMode::ThreadSafe>> Peers;
+	TSharedRef<FInternetAddr> From = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateInternetAddr();
+	TArray<uint8> Datagram;
+	Datagram.SetNumUninitialized(MAX_DATAGRAM_SIZE);
+	double NextSweep = FPlatformTime::Seconds() + 1.0;
+	bool bWantsSweep = false;
+	bool bDisconnectAll = false;
+	TSet<FString> Disconnects;
+
+	auto ForgetPeer = [this](const TSharedPtr<ClientSocket, ESPMode::ThreadSafe>& Peer)
+	{
+		{
+			FScopeLock Lock(&ClientsMx);
+			Clients.Remove(Peer->Address);
+		}
+		Sensors.Unregister(Peer->UID);
+
+		const FString Address = Peer->Address;
+		AsyncTask(ENamedThreads::GameThread, [this, Address]()
+		{
+			OnClientDisconnected.Broadcast(Address);
+		});
+	};
+
+	while (bShouldServe)
+	{
+		if (UdpSocket->Wait(ESocketWaitConditions::WaitForRead, FTimespan::FromMilliseconds(UDP_WAIT_MS)))
+		{
+			// Non-blocking, drain everything that queued up
+			int32 Read = 0;
+			while (UdpSocket->RecvFrom(Datagram.GetData(), Datagram.Num(), Read, *From) && Read > 0)
+			{
+				uint32 Ip = 0;
+				From->GetIp(Ip);
+				const uint64 Key = ((uint64) Ip << 16) | (uint16) From->GetPort();
+
+				TSharedPtr<ClientSocket, ESPMode::ThreadSafe>& Peer = Peers.FindOrAdd(Key);
+				if (!Peer.IsValid())
 				{
-					const FString Address = ClientToRemove->Address;
-					Clients.Remove(Address);
+					// Never sent to, so the send queue stays at its minimum size
+					Peer = MakeShareable(new ClientSocket(0));
+					Peer->Address = From->ToString(true);
+					Peer->Socket = nullptr;
+					Peer->bDatagram = true;
+					Peer->UID = Sensors.Register();
+					{
+						FScopeLock Lock(&ClientsMx);
+						Clients.Add(Peer->Address, Peer);
+					}
+					UE_LOG(LogTemp, Log, TEXT("[ServerSocket] New UDP device: %s."), *Peer->Address);
+
+					const FString Address = Peer->Address;
 					AsyncTask(ENamedThreads::GameThread, [this, Address]()
 					{
-						OnClientDisconnected.Broadcast(Address);
+						OnClientConnected.Broadcast(Address);
 					});
 				}
-				ClientsDisconnected.Empty();
+
+				Peer->LastReceiveCycles = FPlatformTime::Cycles64();
+				Peer->LastHeard = FPlatformTime::Seconds();
+				HandleDatagram(*Peer, Datagram.GetData(), Read);
+				bWantsSweep |= Peer->bWantsClose;
 			}
+		}
 
-			//sleep for 100microns
-			FPlatformProcess::Sleep(0.0001);
-		}//end while
+		FString Disconnect;
+		while (UdpPendingDisconnects.Dequeue(Disconnect))
+		{
+			if (Disconnect == TEXT("All")) bDisconnectAll = true;
+			else Disconnects.Add(Disconnect);
+			bWantsSweep = true;
+		}
 
-		for (auto ClientPair : Clients)
+		// Datagrams have no disconnect, forget devices that went quiet, misbehaved or were asked to leave
+		const double Now = FPlatformTime::Seconds();
+		if (bWantsSweep || Now >= NextSweep)
 		{
-			ClientPair.Value->Socket->Close();
+			for (auto It = Peers.CreateIterator(); It; ++It)
+			{
+				const TSharedPtr<ClientSocket, ESPMode::ThreadSafe>& Peer = It.Value();
+				const bool bTimedOut = Now - Peer->LastHeard > UdpPeerTimeout;
+				if (bTimedOut || Peer->bWantsClose || bDisconnectAll || Disconnects.Contains(Peer->Address))
+				{
+					UE_LOG(LogTemp, Log, TEXT("[ServerSocket] UDP device %s: %s."), bTimedOut ? TEXT("timed out") : TEXT("disconnected"), *Peer->Address);
+					ForgetPeer(Peer);
+					It.RemoveCurrent();
+				}
+			}
+			Disconnects.Reset();
+			bDisconnectAll = false;
+			bWantsSweep = false;
+			if (Now >= NextSweep) NextSweep = Now + 1.0;
 		}
-		Clients.Empty();
+	}
 
-		//Server ended
-		AsyncTask(ENamedThreads::GameThread, [&]()
+	for (const auto& Pair : Peers)
+	{
+		ForgetPeer(Pair.Value);
+	}
+}
+
+void UServerSocket::HandleDatagram(ClientSocket& Peer, const uint8* Data, int32 Size)
+{
+	if (Size < (int32) SimlyProtocol::DatagramHeaderSize)
+	{
+		return;
+	}
+	UdpDatagrams.Increment();
+
+	BufferView Header(Data, SimlyProtocol::DatagramHeaderSize);
+	const uint32 Sequence = SimlyProtocol::readDatagramSequence(Header);
+
+	// Only the newest sample counts, a datagram older than one already handled is ignored.
+	// Far behind means the device restarted its sequence
+	const int32 Gap = (int32) (Sequence - Peer.NextSequence);
+	if (Peer.bHasSequence && Gap < 0 && Gap >= -UDP_REORDER_WINDOW)
+	{
+		UdpReordered.Increment();
+		return;
+	}
+	if (Peer.bHasSequence && Gap > 0)
+	{
+		UdpDropped.Add(Gap);
+	}
+	Peer.bHasSequence = true;
+	Peer.NextSequence = Sequence + 1;
+
+	// Packets are framed exactly like the TCP stream, a datagram may carry several
+	const uint8* Packet = Data + SimlyProtocol::DatagramHeaderSize;
+	int32 Remaining = Size - (int32) SimlyProtocol::DatagramHeaderSize;
+	while (Remaining >= (int32) PacketFramer::HeaderSize)
+	{
+		BufferView LengthPrefix(Packet, PacketFramer::HeaderSize);
+		const int32 Length = LengthPrefix.readUInt16_LE();
+		if (Length < 2 || Length > Remaining - (int32) PacketFramer::HeaderSize)
 		{
-			Clients.Empty();
-			OnListenEnd.Broadcast();
-		});
+			UE_LOG(LogTemp, Verbose, TEXT("[ServerSocket] Malformed datagram from %s."), *Peer.Address);
+			return;
+		}
+
+		BufferView Body(Packet + PacketFramer::HeaderSize, Length);
+		Peer.ProcessPacket(this, Body);
+
+		Packet += PacketFramer::HeaderSize + Length;
+		Remaining -= (int32) PacketFramer::HeaderSize + Length;
+	}
+}
+
+bool UServerSocket::FlushClient(FServerShard& Shard, ClientSocket* Client)
+{
+	if (!Client->FlushSend())
+	{
+		return false;
+	}
+
+	// Only ask for writability while there is a backlog, otherwise we'd wake up constantly
+	const ESocketPollFlags Interest = Client->SendQueue.IsEmpty()
+		? ESocketPollFlags::Readable
+		: ESocketPollFlags::Readable | ESocketPollFlags::Writable;
+	Shard.Poller->Modify(Client->Socket, Client, Interest);
+	return true;
+}
+
+void UServerSocket::RemoveClient(FServerShard& Shard, const FString& Address)
+{
+	const int32 Index = Shard.Clients.IndexOfByPredicate([&Address](const TSharedPtr<ClientSocket, ESPMode::ThreadSafe>& Other) { return Other->Address == Address; });
+	if (Index == INDEX_NONE)
+	{
+		return;
+	}
+
+	TSharedPtr<ClientSocket, ESPMode::ThreadSafe> Client = Shard.Clients[Index];
+	Shard.Clients.RemoveAtSwap(Index);
+	Shard.NumClients.Decrement();
+	{
+		FScopeLock Lock(&ClientsMx);
+		Clients.Remove(Address);
+	}
+	Sensors.Unregister(Client->UID);
+
+	if (Client->Socket)
+	{
+		Shard.Poller->Remove(Client->Socket);
+		Client->Socket->Close();
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(Client->Socket);
+		Client->Socket = nullptr;
+	}
+
+	AsyncTask(ENamedThreads::GameThread, [this, Address]()
+	{
+		OnClientDisconnected.Broadcast(Address);
 	});
 }
 
+FTimespan UServerSocket::RunPingLogic(FServerShard& Shard)
+{
+	const FDateTime Now = FDateTime::Now();
+	const FTimespan Interval = FTimespan::FromSeconds(PingInterval);
+	FTimespan NextPing = Interval;
+
+	for (const TSharedPtr<ClientSocket, ESPMode::ThreadSafe>& Client : Shard.Clients)
+	{
+		FTimespan TimeSinceLastPing = Now - Client->LastPing;
+
+		if (TimeSinceLastPing > Interval)
+		{
+			UE_LOG(LogTemp, Log, TEXT("[ClientSocket] Running Ping Logic, current num: %d"), (int) Client->PingNum);
+			if (Client->PingNum == -1) {
+				// Last ping attempt was succesfull, send new key
+				UE_LOG(LogTemp, Log, TEXT("[ClientSocket] Sending Ping: %d."), (int)Client->PingKey);
+				Client->PingNum = rand();
+				if (Client->SendPing())
+				{
+					Shard.PendingFlushes.Enqueue(Client);
+				}
+			}
+			else
+			{
+				// Previous ping attempt didn't result key in time
+				UE_LOG(LogTemp, Log, TEXT("[ClientSocket] Never got ping! Closing socket."));
+				Shard.PendingDisconnects.Enqueue(Client->Address);
+			}
+			Client->LastPing = Now;
+			TimeSinceLastPing = FTimespan::Zero();
+		}
+
+		NextPing = FMath::Min(NextPing, Interval - TimeSinceLastPing);
+	}
+
+	return FMath::Max(NextPing, FTimespan::Zero());
+}
+
 void UServerSocket::StopListenServer()
 {
 	if (ListenSocket)
 	{
 		bShouldListen = false;
+		Poller->Wakeup();
 		ServerFinishedFuture.Get();
 
+		// Workers stop after the accept thread, so no client can be handed to a worker that already left
+		bShouldServe = false;
+		if (UdpSocket)
+		{
+			UdpFinishedFuture.Get();
+			UdpSocket->Close();
+			ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(UdpSocket);
+			UdpSocket = nullptr;
+		}
+		for (const TUniquePtr<FServerShard>& Shard : Shards)
+		{
+			Shard->Poller->Wakeup();
+			Shard->Finished.Get();
+		}
+		Shards.Empty();
+
 		ListenSocket->Close();
 		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(ListenSocket);
 		ListenSocket = nullptr;
+		Poller.Reset();
 
 		OnListenEnd.Broadcast();
 	}
@@ -218,29 +656,40 @@ void UServerSocket::StopListenServer()
 
 void UServerSocket::DisconnectClient(FString ClientAddress /*= TEXT("All")*/, bool bDisconnectNextTick/*=false*/)
 {
+	// Sockets are owned by their I/O worker, hand the request over and wake it up
 	TFunction<void()> DisconnectFunction = [this, ClientAddress]
 	{
-		bool bDisconnectAll = ClientAddress == TEXT("All");
-
-		if (!bDisconnectAll)
+		const bool bAll = ClientAddress == TEXT("All");
+		int32 ShardIndex = INDEX_NONE;
+		bool bDatagram = false;
+		if (!bAll)
 		{
-			TSharedPtr<ClientSocket> Client = Clients[ClientAddress];
-
-			if (Client.IsValid())
+			FScopeLock Lock(&ClientsMx);
+			const TSharedPtr<ClientSocket, ESPMode::ThreadSafe>* Found = Clients.Find(ClientAddress);
+			if (!Found)
 			{
-				Client->Socket->Close();
-				Clients.Remove(Client->Address);
-				OnClientDisconnected.Broadcast(ClientAddress);
+				return;
 			}
+			ShardIndex = (*Found)->Shard;
+			bDatagram = (*Found)->bDatagram;
 		}
-		else
+
+		// UDP peers are owned by the datagram thread instead
+		if ((bAll || bDatagram) && UdpSocket)
+		{
+			UdpPendingDisconnects.Enqueue(ClientAddress);
+		}
+		if (bDatagram)
+		{
+			return;
+		}
+
+		for (int32 i = 0; i < Shards.Num(); ++i)
 		{
-			for (auto ClientPair : Clients)
+			if (ShardIndex == INDEX_NONE || ShardIndex == i)
 			{
-				TSharedPtr<ClientSocket> Client = ClientPair.Value;
-				Client->Socket->Close();
-				Clients.Remove(Client->Address);
-				OnClientDisconnected.Broadcast(ClientAddress);
+				Shards[i]->PendingDisconnects.Enqueue(ClientAddress);
+				Shards[i]->Poller->Wakeup();
 			}
 		}
 	};
@@ -258,12 +707,217 @@ void UServerSocket::DisconnectClient(FString ClientAddress /*= TEXT("All")*/, bo
 
 void UServerSocket::SendRotationRequest(FString client, FRotatorSensor request)
 {
-	TSharedPtr<ClientSocket> Client = Clients[client];
+	TSharedPtr<ClientSocket, ESPMode::ThreadSafe> Client;
+	{
+		FScopeLock Lock(&ClientsMx);
+		if (const TSharedPtr<ClientSocket, ESPMode::ThreadSafe>* Found = Clients.Find(client))
+		{
+			Client = *Found;
+		}
+	}
 
-	if (Client.IsValid())
+	if (!Client.IsValid())
 	{
-		Client->SendRotationRequest(request);
+		return;
 	}
+
+	// Datagram peers have no connection and no I/O worker that would ever flush a queued packet
+	if (Client->bDatagram)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Rotation request to %s dropped, it only sends over UDP"), *client);
+		return;
+	}
+
+	// Only queues the packet, the client's I/O worker does the actual (non-blocking) send
+	if (Client->SendRotationRequest(request) && Shards.IsValidIndex(Client->Shard))
+	{
+		FServerShard& Shard = *Shards[Client->Shard];
+		Shard.PendingFlushes.Enqueue(Client);
+		Shard.Poller->Wakeup();
+	}
+}
+
+int32 UServerSocket::GetClientUID(FString Client)
+{
+	FScopeLock Lock(&ClientsMx);
+	const TSharedPtr<ClientSocket, ESPMode::ThreadSafe>* Found = Clients.Find(Client);
+	return Found ? (*Found)->UID : INDEX_NONE;
+}
+
+bool UServerSocket::GetLatestForce(int32 UID, FForceSensor& Force) const
+{
+	return Sensors.GetLatestForce(UID, Force);
+}
+
+bool UServerSocket::GetLatestRotation(int32 UID, FRotatorSensor& Rotation) const
+{
+	return Sensors.GetLatestRotation(UID, Rotation);
+}
+
+void UServerSocket::QueueSensorEvent(const ClientSocket& Client, bool bRotation)
+{
+	if (bRotation) Sensors.WriteRotation(Client.UID, Client.Rotation);
+	else Sensors.WriteForce(Client.UID, Client.Force);
+
+	FScopeLock Lock(Client.bDatagram ? &UdpEventsMx : &Shards[Client.Shard]->EventsMx);
+	FSensorEventBatch& Batch = Client.bDatagram ? UdpEvents : Shards[Client.Shard]->Events;
+
+	// Copied now, the worker keeps overwriting the client's values with newer packets
+	FSensorEvent& Event = AddSensorEvent(Batch, Client, bRotation, SensorHistorySize > 0);
+	if (bRotation) Event.Rotation = Client.Rotation;
+	else Event.Force = Client.Force;
+}
+
+bool UServerSocket::QueueForceBatch(ClientSocket& Client, BufferView& Packet)
+{
+	bool bDecoded = false;
+	{
+		FScopeLock Lock(Client.bDatagram ? &UdpEventsMx : &Shards[Client.Shard]->EventsMx);
+		FSensorEventBatch& Batch = Client.bDatagram ? UdpEvents : Shards[Client.Shard]->Events;
+
+		// Every sample of a batch is kept, a newest-only value queued before it would otherwise be broadcast after it
+		Batch.Latest.Remove(MakeTuple((const ClientSocket*) &Client, -1));
+
+		bDecoded = SimlyProtocol::readForceBatch(Packet, [&](const SimlyProtocol::ForceBatchSample& Sample)
+		{
+			FSensorEvent& Event = AddSensorEvent(Batch, Client, false, true);
+			Event.Force.front = Sample.force.front;
+			Event.Force.back = Sample.force.back;
+			Event.Force.left = Sample.force.left;
+			Event.Force.right = Sample.force.right;
+			Event.Force.timestamp = Sample.timestamp;
+			Client.Force = Event.Force;
+		});
+	}
+
+	// Only the newest sample goes to the table, readers there never wanted the history
+	if (bDecoded)
+	{
+		Sensors.WriteForce(Client.UID, Client.Force);
+	}
+	return bDecoded;
+}
+
+FSensorEvent& UServerSocket::AddSensorEvent(FSensorEventBatch& Batch, const ClientSocket& Client, bool bRotation, bool bKeepHistory)
+{
+	FSensorEvent* Event = nullptr;
+	if (bKeepHistory)
+	{
+		// One capacity for single and batched samples, so neither pushes the other out early
+		const int32 HistorySize = FMath::Max(SensorHistorySize, MIN_SENSOR_HISTORY_SIZE);
+		if (Batch.History.Num() < HistorySize)
+		{
+			// Only a SensorHistorySize raised mid tick grows a ring that already wrapped, put it back in order first
+			if (Batch.HistoryStart != 0)
+			{
+				TArray<FSensorEvent> Ordered;
+				Ordered.Reserve(HistorySize);
+				for (int32 i = 0; i < Batch.History.Num(); ++i)
+				{
+					Ordered.Add(MoveTemp(Batch.History[(Batch.HistoryStart + i) % Batch.History.Num()]));
+				}
+				Batch.History = MoveTemp(Ordered);
+				Batch.HistoryStart = 0;
+			}
+			Event = &Batch.History.AddDefaulted_GetRef();
+		}
+		else
+		{
+			// Ring is full, overwrite the oldest sample
+			Event = &Batch.History[Batch.HistoryStart];
+			Batch.HistoryStart = (Batch.HistoryStart + 1) % Batch.History.Num();
+			Batch.NumDropped++;
+		}
+		Event->Client = Client.Address;
+	}
+	else
+	{
+		Event = &Batch.Latest.FindOrAdd(MakeTuple(&Client, bRotation ? (int32) Client.Rotation.id : -1));
+		if (Event->Client.IsEmpty())
+		{
+			Event->Client = Client.Address;
+		}
+	}
+
+	Event->bRotation = bRotation;
+	Event->bDatagram = Client.bDatagram;
+	Event->ReceivedCycles = Client.LastReceiveCycles;
+	return *Event;
+}
+
+void UServerSocket::DispatchSensorEvents()
+{
+	auto Broadcast = [this](const FSensorEvent& Event)
+	{
+		const float LatencyMs = (float) FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - Event.ReceivedCycles);
+		(Event.bDatagram ? UdpLatency : TcpLatency).Add(LatencyMs);
+
+		if (Event.bRotation) OnRotationData.Broadcast(Event.Client, Event.Rotation);
+		else OnForceSensorData.Broadcast(Event.Client, Event.Force);
+	};
+
+	auto Drain = [this, &Broadcast](FCriticalSection& EventsMx, FSensorEventBatch& Events)
+	{
+		DrainedEvents.Reset();
+		{
+			FScopeLock Lock(&EventsMx);
+			Swap(Events, DrainedEvents);
+		}
+
+		if (DrainedEvents.NumDropped > 0)
+		{
+			UE_LOG(LogTemp, Verbose, TEXT("[ServerSocket] Sensor history full, %d samples dropped this tick."), DrainedEvents.NumDropped);
+		}
+
+		const int32 NumHistory = DrainedEvents.History.Num();
+		for (int32 i = 0; i < NumHistory; ++i)
+		{
+			Broadcast(DrainedEvents.History[(DrainedEvents.HistoryStart + i) % NumHistory]);
+		}
+
+		for (const auto& Pair : DrainedEvents.Latest)
+		{
+			Broadcast(Pair.Value);
+		}
+	};
+
+	for (const TUniquePtr<FServerShard>& Shard : Shards)
+	{
+		Drain(Shard->EventsMx, Shard->Events);
+	}
+	Drain(UdpEventsMx, UdpEvents);
+}
+
+FSensorTransportStats UServerSocket::GetTransportStats(bool bUdp) const
+{
+	const FLatencyHistory& Latency = bUdp ? UdpLatency : TcpLatency;
+
+	FSensorTransportStats Stats;
+	Stats.Events = Latency.Events;
+	Stats.P50LatencyMs = Latency.GetPercentile(0.5f);
+	Stats.P99LatencyMs = Latency.GetPercentile(0.99f);
+	if (bUdp)
+	{
+		Stats.Datagrams = UdpDatagrams.GetValue();
+		Stats.Dropped = UdpDropped.GetValue();
+		Stats.Reordered = UdpReordered.GetValue();
+	}
+	return Stats;
+}
+
+void UServerSocket::ResetTransportStats()
+{
+	TcpLatency.Reset();
+	UdpLatency.Reset();
+	UdpDatagrams.Reset();
+	UdpDropped.Reset();
+	UdpReordered.Reset();
+}
+
+void UServerSocket::TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+	DispatchSensorEvents();
 }
 
 void UServerSocket::InitializeComponent()
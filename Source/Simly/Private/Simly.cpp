@@ -2,12 +2,27 @@
 
 #include "Simly.h"
 #include "RealSenseHardwareCustomization.h"
+#include "SocketPoller.h"
+#include "IImageWrapperModule.h"
 
 #define LOCTEXT_NAMESPACE "FSimlyModule"
 
 void FSimlyModule::StartupModule()
 {
 	// This code will execute after your module is loaded into memory; the exact timing is specified in the .uplugin file per-module
+
+	// Point cloud video codecs create image wrappers from reader/recorder threads
+	FModuleManager::LoadModuleChecked<IImageWrapperModule>(TEXT("ImageWrapper"));
+
+	// Which socket wait this build compiled in, the portable one wakes every millisecond per I/O thread
+	if (FCString::Strcmp(FSocketPoller::GetBackendName(), TEXT("portable")) == 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[Simly] Engine private socket headers not found, the server polls its sockets every millisecond."));
+	}
+	else
+	{
+		UE_LOG(LogTemp, Log, TEXT("[Simly] Server sockets wait with %s."), FSocketPoller::GetBackendName());
+	}
 #if WITH_EDITOR
 	FRealSenseHardwareCustomization::Register();
 #endif
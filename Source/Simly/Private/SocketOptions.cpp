@@ -0,0 +1,93 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "SocketOptions.h"
+#include "NativeSocket.h"
+
+#if !SIMLY_NATIVE_SOCKETS
+// Keepalive timings and busy polling need the native handle, only FSocket's options are left
+#elif PLATFORM_WINDOWS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#include <winsock2.h>
+#include <mstcpip.h>
+#include "NativeSocketOptions.h"
+#include "Windows/HideWindowsPlatformTypes.h"
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include "NativeSocketOptions.h"
+#endif
+
+#if SIMLY_NATIVE_SOCKETS
+
+static int GetLastSocketError()
+{
+#if PLATFORM_WINDOWS
+	return WSAGetLastError();
+#else
+	return errno;
+#endif
+}
+
+bool SimlySocketOptions::Apply(FSocket* Socket, const FServerSocketOptions& Options)
+{
+	if (!Socket) return false;
+
+	NativeSocketOptions::Settings Settings;
+	Settings.noDelay = Options.bNoDelay;
+	Settings.receiveBufferSize = Options.ReceiveBufferSize;
+	Settings.sendBufferSize = Options.SendBufferSize;
+	Settings.keepAlive = Options.bKeepAlive;
+	Settings.keepAliveIdleSeconds = Options.KeepAliveIdleSeconds;
+	Settings.keepAliveIntervalSeconds = Options.KeepAliveIntervalSeconds;
+	Settings.keepAliveProbes = Options.KeepAliveProbes;
+	Settings.busyPollMicroseconds = Options.BusyPollMicroseconds;
+
+	return NativeSocketOptions::apply(SimlyNativeSocket::Get(Socket), Settings, [](const char* Option, int Value)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("[SocketOptions] Unable to set %s to %d: %d."), ANSI_TO_TCHAR(Option), Value, GetLastSocketError());
+	});
+}
+
+#else
+
+bool SimlySocketOptions::Apply(FSocket* Socket, const FServerSocketOptions& Options)
+{
+	if (!Socket) return false;
+
+	bool bApplied = Socket->SetNoDelay(Options.bNoDelay);
+
+	// The OS may round or cap the sizes, only a refusal counts as failure
+	int32 ActualSize = 0;
+	if (Options.ReceiveBufferSize > 0)
+	{
+		bApplied &= Socket->SetReceiveBufferSize(Options.ReceiveBufferSize, ActualSize);
+	}
+	if (Options.SendBufferSize > 0)
+	{
+		bApplied &= Socket->SetSendBufferSize(Options.SendBufferSize, ActualSize);
+	}
+
+	if (Options.bKeepAlive || Options.BusyPollMicroseconds > 0)
+	{
+		// Once per run, Apply runs for every accepted client
+		static FThreadSafeBool bWarned;
+		if (!bWarned.AtomicSet(true))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("[SocketOptions] Keepalive and busy polling need native socket access, which this engine build doesn't expose."));
+		}
+		bApplied = false;
+	}
+
+	return bApplied;
+}
+
+#endif
@@ -0,0 +1,393 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "SocketPoller.h"
+#include "NativeSocket.h"
+#include "SocketSubsystem.h"
+#include "Common/UdpSocketBuilder.h"
+
+// Without native handles every socket is checked through FSocket::Wait
+#define SIMLY_POLLER_NATIVE SIMLY_NATIVE_SOCKETS
+#define SIMLY_POLLER_NATIVE_EPOLL (SIMLY_POLLER_NATIVE && SIMLY_POLLER_EPOLL)
+#define SIMLY_POLLER_NATIVE_POLL (SIMLY_POLLER_NATIVE && !SIMLY_POLLER_EPOLL)
+
+#if PLATFORM_WINDOWS
+#include "Windows/AllowWindowsPlatformTypes.h"
+#include <winsock2.h>
+#include "Windows/HideWindowsPlatformTypes.h"
+#elif SIMLY_POLLER_NATIVE_EPOLL
+#include <sys/epoll.h>
+#include <unistd.h>
+#else
+#include <poll.h>
+#endif
+
+#if !PLATFORM_WINDOWS
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <errno.h>
+#endif
+
+#define MAX_POLL_EVENTS 256
+
+// Sleep between two passes over the sockets on the portable path, the wakeup socket cuts it short
+#define PORTABLE_POLL_INTERVAL_MS 1
+
+#if SIMLY_POLLER_NATIVE
+
+static FNativeSocketHandle GetNativeSocket(FSocket* Socket)
+{
+	return SimlyNativeSocket::Get(Socket);
+}
+
+static int32 ToPollTimeout(FTimespan Timeout)
+{
+	if (Timeout < FTimespan::Zero()) return -1;
+	return (int32) FMath::Min<double>(Timeout.GetTotalMilliseconds(), MAX_int32);
+}
+
+#endif
+
+#if SIMLY_POLLER_NATIVE_EPOLL
+
+static uint32 ToNativeInterest(ESocketPollFlags Interest)
+{
+	uint32 Events = EPOLLRDHUP;
+	if (EnumHasAnyFlags(Interest, ESocketPollFlags::Readable)) Events |= EPOLLIN;
+	if (EnumHasAnyFlags(Interest, ESocketPollFlags::Writable)) Events |= EPOLLOUT;
+	return Events;
+}
+
+static ESocketPollFlags FromNativeEvents(uint32 Events)
+{
+	ESocketPollFlags Flags = ESocketPollFlags::None;
+	if (Events & EPOLLIN) Flags |= ESocketPollFlags::Readable;
+	if (Events & EPOLLOUT) Flags |= ESocketPollFlags::Writable;
+	if (Events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP)) Flags |= ESocketPollFlags::Closed;
+	return Flags;
+}
+
+#elif SIMLY_POLLER_NATIVE_POLL
+
+static int NativePoll(pollfd* Fds, int32 Num, int32 TimeoutMs)
+{
+#if PLATFORM_WINDOWS
+	return WSAPoll(Fds, Num, TimeoutMs);
+#else
+	return poll(Fds, Num, TimeoutMs);
+#endif
+}
+
+static short ToNativeInterest(ESocketPollFlags Interest)
+{
+	short Events = 0;
+	if (EnumHasAnyFlags(Interest, ESocketPollFlags::Readable)) Events |= POLLIN;
+	if (EnumHasAnyFlags(Interest, ESocketPollFlags::Writable)) Events |= POLLOUT;
+	return Events;
+}
+
+static ESocketPollFlags FromNativeEvents(short Events)
+{
+	ESocketPollFlags Flags = ESocketPollFlags::None;
+	if (Events & POLLIN) Flags |= ESocketPollFlags::Readable;
+	if (Events & POLLOUT) Flags |= ESocketPollFlags::Writable;
+	if (Events & (POLLHUP | POLLERR | POLLNVAL)) Flags |= ESocketPollFlags::Closed;
+	return Flags;
+}
+
+#endif
+
+FSocketPoller::FSocketPoller()
+{
+	// Loopback datagram socket used to interrupt a blocking wait
+	FIPv4Endpoint WakeEndpoint(FIPv4Address::InternalLoopback, 0);
+	WakeSocket = FUdpSocketBuilder(TEXT("simly-poller-wakeup"))
+		.AsNonBlocking()
+		.BoundToEndpoint(WakeEndpoint)
+		.Build();
+
+	if (!WakeSocket)
+	{
+		UE_LOG(LogTemp, Error, TEXT("[SocketPoller] Unable to create wakeup socket."));
+		return;
+	}
+
+	WakeAddress = ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->CreateInternetAddr();
+	WakeSocket->GetAddress(*WakeAddress);
+	WakeAddress->SetIp(FIPv4Address::InternalLoopback.Value);
+
+#if SIMLY_POLLER_NATIVE_EPOLL
+	EpollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (EpollFd < 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("[SocketPoller] epoll_create1 failed: %d."), errno);
+		return;
+	}
+
+	epoll_event Event = {};
+	Event.events = EPOLLIN;
+	Event.data.ptr = &WakeSocket;
+	epoll_ctl(EpollFd, EPOLL_CTL_ADD, GetNativeSocket(WakeSocket), &Event);
+
+	NativeEvents.SetNumUninitialized(sizeof(epoll_event) * MAX_POLL_EVENTS);
+#endif
+
+	bValid = true;
+}
+
+FSocketPoller::~FSocketPoller()
+{
+#if SIMLY_POLLER_NATIVE_EPOLL
+	if (EpollFd >= 0)
+	{
+		close(EpollFd);
+	}
+#endif
+
+	if (WakeSocket)
+	{
+		WakeSocket->Close();
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(WakeSocket);
+		WakeSocket = nullptr;
+	}
+}
+
+bool FSocketPoller::Add(FSocket* Socket, void* UserData, ESocketPollFlags Interest)
+{
+	if (!bValid || !Socket) return false;
+
+#if SIMLY_POLLER_NATIVE_EPOLL
+	epoll_event Event = {};
+	Event.events = ToNativeInterest(Interest);
+	Event.data.ptr = UserData;
+	if (epoll_ctl(EpollFd, EPOLL_CTL_ADD, GetNativeSocket(Socket), &Event) != 0)
+	{
+		UE_LOG(LogTemp, Error, TEXT("[SocketPoller] Unable to register socket: %d."), errno);
+		return false;
+	}
+#endif
+
+	Registrations.Add({ Socket, UserData, Interest });
+	return true;
+}
+
+bool FSocketPoller::Modify(FSocket* Socket, void* UserData, ESocketPollFlags Interest)
+{
+	FRegistration* Registration = Registrations.FindByPredicate([Socket](const FRegistration& Other) { return Other.Socket == Socket; });
+	if (!Registration) return false;
+
+	if (Registration->Interest == Interest && Registration->UserData == UserData) return true;
+
+#if SIMLY_POLLER_NATIVE_EPOLL
+	epoll_event Event = {};
+	Event.events = ToNativeInterest(Interest);
+	Event.data.ptr = UserData;
+	if (epoll_ctl(EpollFd, EPOLL_CTL_MOD, GetNativeSocket(Socket), &Event) != 0)
+	{
+		return false;
+	}
+#endif
+
+	Registration->UserData = UserData;
+	Registration->Interest = Interest;
+	return true;
+}
+
+void FSocketPoller::Remove(FSocket* Socket)
+{
+	const int32 Index = Registrations.IndexOfByPredicate([Socket](const FRegistration& Other) { return Other.Socket == Socket; });
+	if (Index == INDEX_NONE) return;
+
+#if SIMLY_POLLER_NATIVE_EPOLL
+	epoll_event Event = {};
+	epoll_ctl(EpollFd, EPOLL_CTL_DEL, GetNativeSocket(Socket), &Event);
+#endif
+
+	Registrations.RemoveAtSwap(Index);
+}
+
+int32 FSocketPoller::Wait(TArray<FSocketPollEvent>& OutEvents, FTimespan Timeout)
+{
+	OutEvents.Reset();
+	if (!bValid) return 0;
+
+#if SIMLY_POLLER_NATIVE_EPOLL
+	epoll_event* Events = (epoll_event*) NativeEvents.GetData();
+	const int Count = epoll_wait(EpollFd, Events, MAX_POLL_EVENTS, ToPollTimeout(Timeout));
+
+	for (int i = 0; i < Count; ++i)
+	{
+		if (Events[i].data.ptr == &WakeSocket)
+		{
+			DrainWakeup();
+			continue;
+		}
+		OutEvents.Add({ Events[i].data.ptr, FromNativeEvents(Events[i].events) });
+	}
+#elif SIMLY_POLLER_NATIVE_POLL
+	const int32 NumFds = Registrations.Num() + 1;
+	NativeFds.SetNumUninitialized(sizeof(pollfd) * NumFds, false);
+	pollfd* Fds = (pollfd*) NativeFds.GetData();
+
+	Fds[0].fd = GetNativeSocket(WakeSocket);
+	Fds[0].events = POLLIN;
+	Fds[0].revents = 0;
+	for (int32 i = 0; i < Registrations.Num(); ++i)
+	{
+		Fds[i + 1].fd = GetNativeSocket(Registrations[i].Socket);
+		Fds[i + 1].events = ToNativeInterest(Registrations[i].Interest);
+		Fds[i + 1].revents = 0;
+	}
+
+	const int Count = NativePoll(Fds, NumFds, ToPollTimeout(Timeout));
+	if (Count > 0)
+	{
+		if (Fds[0].revents) DrainWakeup();
+		for (int32 i = 1; i < NumFds; ++i)
+		{
+			if (Fds[i].revents)
+			{
+				OutEvents.Add({ Registrations[i - 1].UserData, FromNativeEvents(Fds[i].revents) });
+			}
+		}
+	}
+#else
+	// Portable path, check every socket and sleep on the wakeup socket in between
+	const double Deadline = Timeout < FTimespan::Zero() ? MAX_dbl : FPlatformTime::Seconds() + Timeout.GetTotalSeconds();
+	while (true)
+	{
+		for (const FRegistration& Registration : Registrations)
+		{
+			ESocketPollFlags Flags = ESocketPollFlags::None;
+			if (EnumHasAnyFlags(Registration.Interest, ESocketPollFlags::Readable) && Registration.Socket->Wait(ESocketWaitConditions::WaitForRead, FTimespan::Zero()))
+			{
+				Flags |= ESocketPollFlags::Readable;
+			}
+			if (EnumHasAnyFlags(Registration.Interest, ESocketPollFlags::Writable) && Registration.Socket->Wait(ESocketWaitConditions::WaitForWrite, FTimespan::Zero()))
+			{
+				Flags |= ESocketPollFlags::Writable;
+			}
+			if (Registration.Socket->GetConnectionState() == SCS_ConnectionError)
+			{
+				Flags |= ESocketPollFlags::Closed;
+			}
+			if (Flags != ESocketPollFlags::None)
+			{
+				OutEvents.Add({ Registration.UserData, Flags });
+			}
+		}
+
+		const double Remaining = Deadline - FPlatformTime::Seconds();
+		if (OutEvents.Num() > 0 || Remaining <= 0.0)
+		{
+			break;
+		}
+
+		const FTimespan Sleep = FTimespan::FromMilliseconds(FMath::Min<double>(PORTABLE_POLL_INTERVAL_MS, Remaining * 1000.0));
+		if (WakeSocket->Wait(ESocketWaitConditions::WaitForRead, Sleep))
+		{
+			DrainWakeup();
+			break;
+		}
+	}
+#endif
+
+	return OutEvents.Num();
+}
+
+void FSocketPoller::Wakeup()
+{
+	if (!bValid || bWakePending.AtomicSet(true)) return;
+
+	uint8 Byte = 0;
+	int32 Sent = 0;
+	WakeSocket->SendTo(&Byte, sizeof(Byte), Sent, *WakeAddress);
+}
+
+const TCHAR* FSocketPoller::GetBackendName()
+{
+#if SIMLY_POLLER_NATIVE_EPOLL
+	return TEXT("epoll");
+#elif SIMLY_POLLER_NATIVE_POLL
+	return TEXT("poll");
+#else
+	return TEXT("portable");
+#endif
+}
+
+void FSocketPoller::DrainWakeup()
+{
+	bWakePending = false;
+
+	uint8 Scratch[64];
+	int32 Read = 0;
+	while (WakeSocket->Recv(Scratch, sizeof(Scratch), Read) && Read > 0)
+	{
+	}
+}
+
+bool FSocketPoller::SendGather(FSocket* Socket, const uint8* First, int32 FirstLength, const uint8* Second, int32 SecondLength, int32& BytesSent)
+{
+	BytesSent = 0;
+
+#if !SIMLY_POLLER_NATIVE
+	// Two sends, the second only when the first went out completely
+	int32 Sent = 0;
+	if (!Socket->Send(First, FirstLength, Sent))
+	{
+		return ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->GetLastErrorCode() == SE_EWOULDBLOCK;
+	}
+	BytesSent = Sent;
+	if (Sent == FirstLength && SecondLength > 0)
+	{
+		if (!Socket->Send(Second, SecondLength, Sent))
+		{
+			return ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->GetLastErrorCode() == SE_EWOULDBLOCK;
+		}
+		BytesSent += Sent;
+	}
+#elif PLATFORM_WINDOWS
+	const int32 NumBuffers = SecondLength > 0 ? 2 : 1;
+	WSABUF Buffers[2];
+	Buffers[0].buf = (CHAR*) First;
+	Buffers[0].len = (ULONG) FirstLength;
+	Buffers[1].buf = (CHAR*) Second;
+	Buffers[1].len = (ULONG) SecondLength;
+
+	DWORD Sent = 0;
+	if (WSASend(GetNativeSocket(Socket), Buffers, NumBuffers, &Sent, 0, nullptr, nullptr) != 0)
+	{
+		return WSAGetLastError() == WSAEWOULDBLOCK;
+	}
+	BytesSent = (int32) Sent;
+#else
+	const int32 NumBuffers = SecondLength > 0 ? 2 : 1;
+	iovec Buffers[2];
+	Buffers[0].iov_base = (void*) First;
+	Buffers[0].iov_len = (size_t) FirstLength;
+	Buffers[1].iov_base = (void*) Second;
+	Buffers[1].iov_len = (size_t) SecondLength;
+
+	msghdr Message = {};
+	Message.msg_iov = Buffers;
+	Message.msg_iovlen = NumBuffers;
+
+#ifdef MSG_NOSIGNAL
+	const ssize_t Sent = sendmsg(GetNativeSocket(Socket), &Message, MSG_NOSIGNAL);
+#else
+	const ssize_t Sent = sendmsg(GetNativeSocket(Socket), &Message, 0);
+#endif
+	if (Sent < 0)
+	{
+		return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+	}
+	BytesSent = (int32) Sent;
+#endif
+
+	return true;
+}
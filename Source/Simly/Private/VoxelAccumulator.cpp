@@ -0,0 +1,122 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "VoxelAccumulator.h"
+#include "Async/ParallelFor.h"
+
+// Past this many samples a voxel's average no longer moves, stop before the sums could overflow
+#define MAX_VOXEL_SAMPLES 65536
+
+void FVoxelAccumulator::SetVoxelSize(float InVoxelSize)
+{
+	InVoxelSize = FMath::Max(InVoxelSize, KINDA_SMALL_NUMBER);
+	if (InVoxelSize == VoxelSize) return;
+
+	VoxelSize = InVoxelSize;
+	Reset();
+}
+
+void FVoxelAccumulator::Reset()
+{
+	Cells.Empty();
+	PendingKeys.Empty();
+	NumUpdatedCells = 0;
+	Bounds = FBox(ForceInit);
+}
+
+void FVoxelAccumulator::AddPoints(const FPointCloudBuffer& Points, const FTransform& Transform)
+{
+	const float InvVoxelSize = 1.0f / VoxelSize;
+
+	// Transform and quantize in parallel, only the map update is serial
+	Quantized.SetNumUninitialized(Points.Num(), false);
+	ParallelFor(Points.Num(), [&](int32 Index)
+	{
+		FQuantizedPoint& Out = Quantized[Index];
+		Out.bValid = Points.IsValid(Index);
+		if (!Out.bValid) return;
+
+		Out.Position = Transform.TransformPosition(Points.GetLocation(Index));
+		Out.Key = FIntVector(
+			FMath::FloorToInt(Out.Position.X * InvVoxelSize),
+			FMath::FloorToInt(Out.Position.Y * InvVoxelSize),
+			FMath::FloorToInt(Out.Position.Z * InvVoxelSize));
+	});
+
+	// Neighbouring pixels mostly land in the same voxel, so remember the last one
+	FVoxelCell* Cell = nullptr;
+	FIntVector CellKey;
+
+	for (int32 Index = 0; Index < Quantized.Num(); ++Index)
+	{
+		const FQuantizedPoint& Point = Quantized[Index];
+		if (!Point.bValid) continue;
+
+		if (!Cell || Point.Key != CellKey)
+		{
+			CellKey = Point.Key;
+			Cell = Cells.Find(CellKey);
+			if (!Cell)
+			{
+				Cell = &Cells.Add(CellKey);
+				PendingKeys.Add(CellKey);
+
+				const FVector Min = FVector(CellKey) * VoxelSize;
+				Bounds += FBox(Min, Min + FVector(VoxelSize));
+			}
+		}
+
+		if (Cell->Count >= MAX_VOXEL_SAMPLES) continue;
+
+		const FColor Color(Points.Colors[Index]);
+		Cell->Count++;
+		Cell->Position += (Point.Position - Cell->Position) / Cell->Count;
+		Cell->RedSum += Color.R;
+		Cell->GreenSum += Color.G;
+		Cell->BlueSum += Color.B;
+
+		// Twice the samples the cloud's copy has, a cheap stand-in for "the average moved"
+		if (Cell->UploadedCount > 0 && !Cell->bUpdated && Cell->Count >= Cell->UploadedCount * 2)
+		{
+			Cell->bUpdated = true;
+			NumUpdatedCells++;
+		}
+	}
+}
+
+void FVoxelAccumulator::ConsumePending(TArray<FLidarPointCloudPoint>& OutPoints)
+{
+	OutPoints.Reset(PendingKeys.Num());
+	for (const FIntVector& Key : PendingKeys)
+	{
+		OutPoints.Add(ToPoint(Cells.FindChecked(Key)));
+	}
+	PendingKeys.Reset();
+}
+
+void FVoxelAccumulator::GetAllPoints(TArray<FLidarPointCloudPoint>& OutPoints)
+{
+	OutPoints.Reset(Cells.Num());
+	for (TPair<FIntVector, FVoxelCell>& Pair : Cells)
+	{
+		OutPoints.Add(ToPoint(Pair.Value));
+	}
+	PendingKeys.Reset();
+	NumUpdatedCells = 0;
+}
+
+FLidarPointCloudPoint FVoxelAccumulator::ToPoint(FVoxelCell& Cell)
+{
+	Cell.UploadedCount = Cell.Count;
+	Cell.bUpdated = false;
+
+	FLidarPointCloudPoint Point;
+	Point.Location = Cell.Position;
+	Point.Color = FColor(Cell.RedSum / Cell.Count, Cell.GreenSum / Cell.Count, Cell.BlueSum / Cell.Count, 255);
+	return Point;
+}
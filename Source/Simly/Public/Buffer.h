@@ -1,17 +1,64 @@
 #pragma once
 #include <vector>  // buffers
 #include <sstream> // strings, byteStr()
+#include <cstring> // memcpy
+#include <cstddef> // size_t
+#if defined(_MSC_VER)
+#include <stdlib.h> // _byteswap_*
+#endif
 
 /*
     From: https://github.com/m-byte918/Binary-Reader-Writer
 */
 
+/*
+    Unaligned load/store helpers, these compile down to a single mov (+ bswap for BE).
+    Like the rest of this file they assume a little endian host.
+*/
+namespace BufferDetail {
+    template <size_t N> struct UInt;
+    template <> struct UInt<1> { typedef unsigned char type; };
+    template <> struct UInt<2> { typedef unsigned short type; };
+    template <> struct UInt<4> { typedef unsigned int type; };
+    template <> struct UInt<8> { typedef unsigned long long type; };
+
+    inline unsigned char byteSwap(unsigned char val) noexcept { return val; }
+#if defined(_MSC_VER)
+    inline unsigned short byteSwap(unsigned short val) noexcept { return _byteswap_ushort(val); }
+    inline unsigned int byteSwap(unsigned int val) noexcept { return _byteswap_ulong(val); }
+    inline unsigned long long byteSwap(unsigned long long val) noexcept { return _byteswap_uint64(val); }
+#else
+    inline unsigned short byteSwap(unsigned short val) noexcept { return __builtin_bswap16(val); }
+    inline unsigned int byteSwap(unsigned int val) noexcept { return __builtin_bswap32(val); }
+    inline unsigned long long byteSwap(unsigned long long val) noexcept { return __builtin_bswap64(val); }
+#endif
+
+    template <class T> inline T load(const unsigned char *src, bool LE) noexcept {
+        typename UInt<sizeof(T)>::type bits;
+        memcpy(&bits, src, sizeof(bits));
+        if (LE == false)
+            bits = byteSwap(bits);
+        T val;
+        memcpy(&val, &bits, sizeof(val));
+        return val;
+    }
+
+    template <class T> inline void store(unsigned char *dst, const T &val, bool LE) noexcept {
+        typename UInt<sizeof(T)>::type bits;
+        memcpy(&bits, &val, sizeof(bits));
+        if (LE == false)
+            bits = byteSwap(bits);
+        memcpy(dst, &bits, sizeof(bits));
+    }
+}
+
 class Buffer {
 public:
     Buffer() noexcept;
     Buffer(const std::vector<unsigned char>&) noexcept;
 
     void setBuffer(std::vector<unsigned char>&) noexcept;
+    void setBuffer(std::vector<unsigned char>&&) noexcept;
     const std::vector<unsigned char> &getBuffer() const noexcept;
     void clear() noexcept;
 
@@ -22,7 +69,8 @@ public:
     template <class T> inline void writeBytes(const T &val, bool LE = true);
     unsigned long long getWriteOffset() const noexcept;
 
-    void writeArray(unsigned char* data, int size) noexcept;
+    // Advances getWriteOffset() like every other write (it used to leave it behind)
+    void writeArray(const unsigned char* data, int size) noexcept;
     void writeBool(bool) noexcept;
     void writeStr(const std::string&) noexcept;
     void writeInt8(char) noexcept;
@@ -50,6 +98,7 @@ public:
 
     /************************** Reading ***************************/
 
+    // Clamped to the end of the buffer
     void setReadOffset(unsigned long long) noexcept;
     unsigned long long getReadOffset() const noexcept;
     template <class T> inline T readBytes(bool LE = true);
@@ -86,3 +135,166 @@ private:
     unsigned long long readOffset = 0;
     unsigned long long writeOffset = 0;
 };
+
+/*
+    Non-owning counterpart of Buffer, reads and writes go straight to caller memory
+    and never allocate. Writes past the capacity and reads past the written size are
+    dropped (reads return 0), check good() afterwards.
+*/
+
+class BufferView {
+public:
+    BufferView() noexcept {}
+    BufferView(unsigned char *_data, size_t _capacity, size_t _size = 0) noexcept:
+        data(_data), capacity(_capacity), writeOffset(_size) {
+    }
+    // Read-only view, there is no room left to write into
+    BufferView(const unsigned char *_data, size_t _size) noexcept:
+        data(const_cast<unsigned char*>(_data)), capacity(_size), writeOffset(_size) {
+    }
+
+    unsigned char *getData() const noexcept { return data; }
+    size_t getCapacity() const noexcept { return capacity; }
+    size_t size() const noexcept { return (size_t)writeOffset; }
+    size_t remaining() const noexcept { return (size_t)(writeOffset - readOffset); }
+    bool good() const noexcept { return !overflow; }
+
+    void clear() noexcept {
+        readOffset = 0;
+        writeOffset = 0;
+        overflow = false;
+    }
+
+    std::string byteStr(bool LE = true) const noexcept {
+        return Buffer(std::vector<unsigned char>(data, data + writeOffset)).byteStr(LE);
+    }
+
+    /************************** Writing ***************************/
+
+    template <class T> inline void writeBytes(const T &val, bool LE = true) noexcept {
+        if (writeOffset + sizeof(T) > capacity) {
+            overflow = true;
+            return;
+        }
+        BufferDetail::store<T>(data + writeOffset, val, LE);
+        writeOffset += sizeof(T);
+    }
+    // Overwrite already written bytes, e.g. a length prefix reserved up front
+    template <class T> inline void writeBytesAt(unsigned long long offset, const T &val, bool LE = true) noexcept {
+        if (offset + sizeof(T) > writeOffset) {
+            overflow = true;
+            return;
+        }
+        BufferDetail::store<T>(data + offset, val, LE);
+    }
+    void setWriteOffset(unsigned long long newOffset) noexcept {
+        if (newOffset > capacity) {
+            overflow = true;
+            return;
+        }
+        writeOffset = newOffset;
+    }
+    unsigned long long getWriteOffset() const noexcept { return writeOffset; }
+
+    void writeArray(const unsigned char *src, size_t len) noexcept {
+        if (writeOffset + len > capacity) {
+            overflow = true;
+            return;
+        }
+        memcpy(data + writeOffset, src, len);
+        writeOffset += len;
+    }
+    void writeBool(bool val) noexcept { writeBytes<unsigned char>(val ? 1 : 0); }
+    void writeStr(const std::string &str) noexcept { writeArray((const unsigned char*)str.data(), str.size()); }
+    void writeInt8(char val) noexcept { writeBytes<char>(val); }
+    void writeUInt8(unsigned char val) noexcept { writeBytes<unsigned char>(val); }
+
+    void writeInt16_LE(short val) noexcept { writeBytes<short>(val); }
+    void writeInt16_BE(short val) noexcept { writeBytes<short>(val, false); }
+    void writeUInt16_LE(unsigned short val) noexcept { writeBytes<unsigned short>(val); }
+    void writeUInt16_BE(unsigned short val) noexcept { writeBytes<unsigned short>(val, false); }
+
+    void writeInt32_LE(int val) noexcept { writeBytes<int>(val); }
+    void writeInt32_BE(int val) noexcept { writeBytes<int>(val, false); }
+    void writeUInt32_LE(unsigned int val) noexcept { writeBytes<unsigned int>(val); }
+    void writeUInt32_BE(unsigned int val) noexcept { writeBytes<unsigned int>(val, false); }
+
+    void writeInt64_LE(long long val) noexcept { writeBytes<long long>(val); }
+    void writeInt64_BE(long long val) noexcept { writeBytes<long long>(val, false); }
+    void writeUInt64_LE(unsigned long long val) noexcept { writeBytes<unsigned long long>(val); }
+    void writeUInt64_BE(unsigned long long val) noexcept { writeBytes<unsigned long long>(val, false); }
+
+    void writeFloat_LE(float val) noexcept { writeBytes<float>(val); }
+    void writeFloat_BE(float val) noexcept { writeBytes<float>(val, false); }
+    void writeDouble_LE(double val) noexcept { writeBytes<double>(val); }
+    void writeDouble_BE(double val) noexcept { writeBytes<double>(val, false); }
+
+    /************************** Reading ***************************/
+
+    // Past the written size it is rejected like a read past the end, remaining() stays valid
+    void setReadOffset(unsigned long long newOffset) noexcept {
+        if (newOffset > writeOffset) {
+            overflow = true;
+            return;
+        }
+        readOffset = newOffset;
+    }
+    unsigned long long getReadOffset() const noexcept { return readOffset; }
+    template <class T> inline T readBytes(bool LE = true) noexcept {
+        // Do not overflow
+        if (readOffset + sizeof(T) > writeOffset) {
+            overflow = true;
+            return T();
+        }
+        T result = BufferDetail::load<T>(data + readOffset, LE);
+        readOffset += sizeof(T);
+        return result;
+    }
+
+    bool               readBool() noexcept { return readBytes<unsigned char>() != 0; }
+    char               readInt8() noexcept { return readBytes<char>(); }
+    unsigned char      readUInt8() noexcept { return readBytes<unsigned char>(); }
+
+    short              readInt16_LE() noexcept { return readBytes<short>(); }
+    short              readInt16_BE() noexcept { return readBytes<short>(false); }
+    unsigned short     readUInt16_LE() noexcept { return readBytes<unsigned short>(); }
+    unsigned short     readUInt16_BE() noexcept { return readBytes<unsigned short>(false); }
+
+    int                readInt32_LE() noexcept { return readBytes<int>(); }
+    int                readInt32_BE() noexcept { return readBytes<int>(false); }
+    unsigned int       readUInt32_LE() noexcept { return readBytes<unsigned int>(); }
+    unsigned int       readUInt32_BE() noexcept { return readBytes<unsigned int>(false); }
+
+    long long          readInt64_LE() noexcept { return readBytes<long long>(); }
+    long long          readInt64_BE() noexcept { return readBytes<long long>(false); }
+    unsigned long long readUInt64_LE() noexcept { return readBytes<unsigned long long>(); }
+    unsigned long long readUInt64_BE() noexcept { return readBytes<unsigned long long>(false); }
+
+    float              readFloat_LE() noexcept { return readBytes<float>(); }
+    float              readFloat_BE() noexcept { return readBytes<float>(false); }
+    double             readDouble_LE() noexcept { return readBytes<double>(); }
+    double             readDouble_BE() noexcept { return readBytes<double>(false); }
+
+private:
+    unsigned char *data = nullptr;
+    unsigned long long capacity = 0;
+    unsigned long long readOffset = 0;
+    unsigned long long writeOffset = 0;
+    bool overflow = false;
+};
+
+/*
+    BufferView over inline storage, for building packets on the stack.
+*/
+
+template <size_t N> class FixedBuffer : public BufferView {
+public:
+    FixedBuffer() noexcept : BufferView(storage, N) {
+    }
+    // The base points into our own storage, copying would alias the source
+    FixedBuffer(const FixedBuffer&) = delete;
+    FixedBuffer &operator=(const FixedBuffer&) = delete;
+
+private:
+    unsigned char storage[N];
+};
@@ -10,7 +10,8 @@
 
 #include "CoreMinimal.h"
 #include "Networking.h"
-#include "Buffer.h"
+#include "SimlyProtocol.h"
+#include "SendQueue.h"
 
 #include "ClientSocket.generated.h"
 
@@ -30,6 +31,9 @@ public:
 		int64 left = 0;
 	UPROPERTY(BlueprintReadOnly, Category = "Sensor Value")
 		int64 right = 0;
+	// Device clock in microseconds, only batched samples carry one
+	UPROPERTY(BlueprintReadOnly, Category = "Sensor Value")
+		int64 timestamp = 0;
 };
 
 USTRUCT(BlueprintType)
@@ -48,17 +52,21 @@ public:
 class ClientSocket 
 {
 public:
+	explicit ClientSocket(int32 SendQueueSize = 64 * 1024) : SendQueue(SendQueueSize) {}
+
 	// Socket
 	FSocket* Socket;
-	Buffer RecvBuff;
+	PacketFramer RecvFramer;
+
+	// Outgoing packets, only the server thread writes them to the socket
+	FSendQueue SendQueue;
+
+	// Set when the connection should be dropped, the server thread does the actual close
+	FThreadSafeBool bWantsClose;
 
 	UPROPERTY(BlueprintReadOnly, Category = "TCP Connection Properties")
 	FString Address;
 
-	// Decoding
-	uint32 DecodeLen = -1;
-	uint32 Header = 2;
-
 	// Data
 	FDateTime LastPing;
 	int32 PingNum = -1;
@@ -68,7 +76,20 @@ public:
 	FForceSensor Force;
 	FRotatorSensor Rotation;
 
-	long UID = -1;
+	// Slot in the server's sensor table, INDEX_NONE when it was full
+	int32 UID = INDEX_NONE;
+
+	// I/O worker of the server that owns this connection, INDEX_NONE for UDP peers
+	int32 Shard = INDEX_NONE;
+
+	// When the last bytes came in, sensor events are timed from here
+	uint64 LastReceiveCycles = 0;
+
+	// UDP peers have no socket of their own, the server's datagram thread feeds them
+	bool bDatagram = false;
+	bool bHasSequence = false;
+	uint32 NextSequence = 0;
+	double LastHeard = 0.0;
 
 	bool operator==(const ClientSocket& Other)
 	{
@@ -76,13 +97,20 @@ public:
 	}
 
 	// Packet handling
-	void ProcessPacket(UServerSocket* server);
-	void SendRotationRequest(FRotatorSensor request);
-	void SendPing();
+	bool ReceiveData(UServerSocket* server);
+	void ProcessPacket(UServerSocket* server, BufferView& Packet);
+
+	// Queue a packet, returns true when the queue was empty and the server has to schedule a flush
+	bool SendRotationRequest(FRotatorSensor request);
+	bool SendPing();
+
+	// Server thread only, returns false on a socket error
+	bool FlushSend();
 
 private:
-	void SendPacket(Buffer OutPacket);
+	bool SendPacket(const BufferView& OutPacket);
 	void HandlePong(uint32 code);
-	void HandleForceSensor(UServerSocket* server);
-	void HandleRotator(UServerSocket* server);
+	void HandleForceSensor(UServerSocket* server, BufferView& Packet);
+	void HandleForceBatch(UServerSocket* server, BufferView& Packet);
+	void HandleRotator(UServerSocket* server, BufferView& Packet);
 };
\ No newline at end of file
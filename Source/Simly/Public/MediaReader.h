@@ -17,6 +17,11 @@
 #include "MovieSceneMediaSection.h"
 #include "LidarPointCloudShared.h"
 #include "LidarPointCloud.h"
+#include "PointCloudConverter.h"
+#include "PointCloudVideoFile.h"
+#include "PointCloudVideoPrefetcher.h"
+#include "PlaybackClock.h"
+#include "Containers/TripleBuffer.h"
 
 #include <exception>
 #include <vector>
@@ -24,6 +29,31 @@
 
 #include "MediaReader.generated.h"
 
+struct FMediaReaderFrame
+{
+	FPointCloudBuffer Points;
+	FBox Bounds = FBox(ForceInit);
+};
+
+USTRUCT(BlueprintType)
+struct FMediaPlaybackStats
+{
+	GENERATED_USTRUCT_BODY()
+public:
+	UPROPERTY(BlueprintReadOnly, Category = "Playback")
+		int32 PresentedFrames = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "Playback")
+		int32 DroppedFrames = 0;
+	/** How late frames were shown after their timestamp, in wall clock ms. */
+	UPROPERTY(BlueprintReadOnly, Category = "Playback")
+		float MeanLatenessMs = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "Playback")
+		float MaxLatenessMs = 0;
+	/** Standard deviation of the lateness. */
+	UPROPERTY(BlueprintReadOnly, Category = "Playback")
+		float JitterMs = 0;
+};
+
 UCLASS(ClassGroup = "Simly", BlueprintType)
 class SIMLY_API AMediaReader : public AActor
 {
@@ -38,12 +68,17 @@ public:
 	UPROPERTY(Category = "Simly", BlueprintReadOnly)
 		ULidarPointCloud* PointCloud;
 
-	UPROPERTY(Category = "Simly", BlueprintReadOnly)
-		TArray<FLidarPointCloudPoint> Points;
+	/** Points of the frame on screen, converted from the internal buffer on every call. */
+	UFUNCTION(Category = "Simly", BlueprintCallable)
+		TArray<FLidarPointCloudPoint> GetPoints() const;
+
+	UFUNCTION(Category = "Simly", BlueprintPure)
+		int32 GetNumPoints() const;
 
 	UFUNCTION(Category = "Simly", BlueprintCallable)
 		void Initialize(FString FileName);
 
+	/** Convert and upload the current frame again, for example after changing the depth settings while paused. */
 	UFUNCTION(Category = "Simly", BlueprintCallable)
 		void UpdatePointCloud();
 
@@ -63,6 +98,77 @@ public:
 	UPROPERTY(Category = "Depth", BlueprintReadWrite, EditAnywhere)
 		float ScaleY = 0.002325581395f;
 
+	/** Row bands converted in parallel per frame, 0 uses one per task graph worker. */
+	UPROPERTY(Category = "Depth", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "0", UIMin = "0", UIMax = "64"))
+		int32 ConversionWorkers = 0;
+
+	/**
+	* Only convert the tiles of a frame that changed, and skip the upload when none did. A frame with any
+	* changed tile is still uploaded whole, the point cloud can't replace a tile's points in place.
+	*/
+	UPROPERTY(Category = "Depth", BlueprintReadWrite, EditAnywhere)
+		bool bIncrementalUpdate = true;
+
+	/** Raw depth units a pixel may drift before its tile is converted again. */
+	UPROPERTY(Category = "Depth", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "0", UIMin = "0", UIMax = "100"))
+		int32 DirtyDepthThreshold = 0;
+
+	/** Per channel color difference a pixel may drift before its tile is converted again. */
+	UPROPERTY(Category = "Depth", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "0", ClampMax = "255", UIMin = "0", UIMax = "64"))
+		int32 DirtyColorThreshold = 0;
+
+	/** Downsample frames before they are converted, recordings keep the full resolution. */
+	UPROPERTY(Category = "Depth", BlueprintReadWrite, EditAnywhere)
+		EDepthDecimation Decimation = EDepthDecimation::None;
+
+	/** Block size for Subsample and Median, 2 keeps a quarter of the points. */
+	UPROPERTY(Category = "Depth", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1", ClampMax = "8", UIMin = "1", UIMax = "8"))
+		int32 DecimationFactor = 2;
+
+	/** Most pixels a frame may convert to with PointBudget decimation. */
+	UPROPERTY(Category = "Depth", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1"))
+		int32 PointBudget = 100000;
+
+	// Playback
+	UPROPERTY(Category = "Playback", BlueprintReadWrite, EditAnywhere)
+		bool bLoop = false;
+
+	/** Frames read and decoded ahead of playback, takes effect on the next Initialize. */
+	UPROPERTY(Category = "Playback", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1", ClampMax = "32", UIMin = "1", UIMax = "32"))
+		int32 PrefetchFrames = 4;
+
+	/** Speed relative to the recording, change it at runtime with SetPlaybackRate. */
+	UPROPERTY(Category = "Playback", BlueprintReadOnly, EditAnywhere, meta = (ClampMin = "0.25", ClampMax = "8", UIMin = "0.25", UIMax = "8"))
+		float PlaybackRate = 1.0f;
+
+	UFUNCTION(Category = "Playback", BlueprintCallable)
+		void SetPlaybackRate(float Rate);
+
+	UFUNCTION(Category = "Playback", BlueprintCallable)
+		void Pause();
+
+	UFUNCTION(Category = "Playback", BlueprintCallable)
+		void Resume();
+
+	/** Jump to the frame shown at Seconds into the recording, also presents it while paused. */
+	UFUNCTION(Category = "Playback", BlueprintCallable)
+		void SeekToTime(float Seconds);
+
+	UFUNCTION(Category = "Playback", BlueprintPure)
+		bool IsPaused() const;
+
+	UFUNCTION(Category = "Playback", BlueprintPure)
+		float GetPlaybackTime() const;
+
+	UFUNCTION(Category = "Playback", BlueprintPure)
+		float GetDuration() const;
+
+	UFUNCTION(Category = "Playback", BlueprintPure)
+		FMediaPlaybackStats GetPlaybackStats() const;
+
+	UFUNCTION(Category = "Playback", BlueprintCallable)
+		void ResetPlaybackStats();
+
 protected:
 
 	virtual void Tick(float DeltaSeconds) override; 
@@ -70,31 +176,37 @@ protected:
 
 private:
 	void ThreadProc();
+	FDepthConversionParams GetConversionParams() const;
 	TUniquePtr<class FMediaReaderWorker> Worker;
 	TUniquePtr<class FRunnableThread> Thread;
+	void StopPlayback();
+	bool ConvertFrame(const FPrefetchedFrame& Frame, FMediaReaderFrame& OutFrame);
 	volatile int StartedFlag = false;
 
-	IFileHandle* FileHandle;
-	uint8* COLOR_BUFFER;
-	uint8* DEPTH_BUFFER;
+	// Pipeline: the prefetcher reads and decodes, the reader thread converts, Tick uploads
+	FPointCloudVideoFile Video;
+	FPointCloudVideoPrefetcher Prefetcher;
 	int Width, Height;
-	uint64 StartTime, TargetTime;
-	TArray<FLidarPointCloudPoint*> aPoints;
-
-	struct RGBA
-	{
-		uint8 r;
-		uint8 g;
-		uint8 b;
-		uint8 a;
-	};
-
-	struct FILEHEADER
-	{
-		uint32 width;
-		uint32 height;
-		uint32 encryption;
-	};
+	FPointCloudConverter Converter;
+
+	// Converted frames are published by the reader thread and picked up by Tick, which uploads them.
+	// Incremental conversion keeps a full frame with a validity mask
+	TTripleBuffer<FMediaReaderFrame> Frames;
+	FPointCloudBuffer DensePoints;
+	uint32 DenseVersion = 0;
+
+	// Game thread, the frame on screen
+	FPointCloudBuffer Points;
+	FBox PointsBounds = FBox(ForceInit);
+	FBox CloudBounds = FBox(ForceInit);
+	TArray<FLidarPointCloudPoint> LidarPoints;
+
+	// Playback state, shared between the game thread and the reader thread
+	mutable FCriticalSection PlaybackMx;
+	FPlaybackClock Clock;
+	bool bSeekPending = false;
+	int32 NextFrame = 0;
+	int32 CurrentFrame = 0;
 };
 
 class FMediaReaderWorker : public FRunnable
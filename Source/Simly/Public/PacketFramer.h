@@ -0,0 +1,40 @@
+#pragma once
+#include <vector>  // ring storage
+#include <cstddef> // size_t
+
+/*
+    Reassembles Simly packets ([uint16 LE length][body]) from a TCP byte stream.
+
+    Bytes are received straight into a power of two ring buffer, so a single
+    Recv can pick up any number of packets. Packets that straddle reads stay
+    in the ring until the rest arrives.
+*/
+
+class PacketFramer {
+public:
+    static const size_t HeaderSize = 2;
+    static const size_t MaxPacketSize = 0xFFFF;
+
+    explicit PacketFramer(size_t capacity = 1 << 17) noexcept;
+
+    // Contiguous free region to receive into, may be shorter than freeSpace() near the wrap point
+    unsigned char *writeSpan(size_t &length) noexcept;
+    void commit(size_t length) noexcept;
+
+    // Body of the next complete packet or nullptr, valid until consume()
+    const unsigned char *nextPacket(size_t &length) noexcept;
+    void consume() noexcept;
+
+    size_t size() const noexcept;
+    size_t freeSpace() const noexcept;
+    size_t capacity() const noexcept;
+    void clear() noexcept;
+
+private:
+    std::vector<unsigned char> ring;
+    std::vector<unsigned char> scratch; // packets that wrap around the end of the ring
+    size_t mask;
+    size_t head = 0; // read position, only ever grows
+    size_t tail = 0; // write position, only ever grows
+    size_t pending = 0;
+};
@@ -0,0 +1,68 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+* Maps wall clock time to media time (ms) for playback at an adjustable rate.
+*
+* Media time is derived from a single anchor instead of summing up frame intervals, so sleeping
+* late or early on one frame never shifts the due time of the next. Pause, Seek and SetRate move
+* the anchor. Also keeps presentation statistics: how late each frame was shown in wall clock ms
+* and how many frames were skipped to catch up.
+*
+* Not thread safe, the owner serializes access.
+*/
+class SIMLY_API FPlaybackClock
+{
+public:
+	/** Paused at MediaTime with cleared statistics, the rate is kept. */
+	void Reset(double MediaTime = 0.0);
+
+	void Pause();
+	void Resume();
+	bool IsPaused() const { return bPaused; }
+
+	void Seek(double MediaTime);
+
+	/** Clamped to 0.25x - 8x, media time continues from where it is now. */
+	void SetRate(float InRate);
+	float GetRate() const { return Rate; }
+
+	double GetMediaTime() const;
+
+	/** Wall clock seconds until MediaTime is reached, 0 when it is already due or the clock is paused. */
+	double GetSecondsUntil(double MediaTime) const;
+
+	/** Records a frame due at DueTime (media ms) that is being shown now. */
+	void AddPresented(double DueTime);
+	void AddDropped(int32 NumFrames);
+	void ResetStats();
+
+	int32 GetNumPresented() const { return NumPresented; }
+	int32 GetNumDropped() const { return NumDropped; }
+	double GetMeanLateness() const { return LatenessMean; }
+	double GetMaxLateness() const { return LatenessMax; }
+	/** Standard deviation of the lateness, the presentation jitter. */
+	double GetJitter() const;
+
+private:
+	double AnchorSeconds = 0.0;
+	double AnchorMediaTime = 0.0;
+	float Rate = 1.0f;
+	bool bPaused = true;
+
+	int32 NumPresented = 0;
+	int32 NumDropped = 0;
+	double LatenessMean = 0.0;
+	double LatenessM2 = 0.0;
+	double LatenessMax = 0.0;
+};
@@ -0,0 +1,51 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "LidarPointCloudShared.h"
+
+/**
+* Structure of arrays point store the conversion kernels write into, one array per component so whole
+* SIMD registers can be stored at once. Only turned into FLidarPointCloudPoints when handed to a point
+* cloud or to Blueprint.
+*/
+struct SIMLY_API FPointCloudBuffer
+{
+	TArray<float> X;
+	TArray<float> Y;
+	TArray<float> Z;
+
+	/** FColor layout (BGRA). */
+	TArray<uint32> Colors;
+
+	/** 1 for pixels that hold a point. Empty for compact buffers, where every point is valid. */
+	TArray<uint8> Valid;
+
+	int32 Num() const { return X.Num(); }
+
+	/** Resizes every component, bWithMask also sizes Valid (dense buffers) instead of emptying it. */
+	void SetNum(int32 Num, bool bWithMask);
+
+	void Reset();
+
+	bool IsValid(int32 Index) const { return Valid.Num() == 0 || Valid[Index] != 0; }
+
+	FVector GetLocation(int32 Index) const { return FVector(X[Index], Y[Index], Z[Index]); }
+
+	/** Number of valid points. */
+	int32 NumValid() const;
+
+	/** The valid points as LiDAR points. */
+	void ToLidarPoints(TArray<FLidarPointCloudPoint>& OutPoints) const;
+
+	/** The valid points as LiDAR points, moved by Transform. */
+	void ToLidarPoints(TArray<FLidarPointCloudPoint>& OutPoints, const FTransform& Transform) const;
+};
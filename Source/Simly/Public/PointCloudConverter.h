@@ -0,0 +1,185 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "LidarPointCloudShared.h"
+#include "PointCloudBuffer.h"
+
+class ULidarPointCloud;
+
+// SSE2 is part of the x64 baseline the engine compiles for
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+#define SIMLY_SIMD_SSE2 1
+#else
+#define SIMLY_SIMD_SSE2 0
+#endif
+
+#include "PointCloudConverter.generated.h"
+
+/** Downsampling applied to a depth frame before it is converted. */
+UENUM(BlueprintType)
+enum class EDepthDecimation : uint8
+{
+	/** Convert every pixel. */
+	None,
+	/** Keep one pixel of every N x N block. */
+	Subsample,
+	/** Median depth of the valid pixels in every N x N block, less noisy than Subsample. */
+	Median,
+	/** Median of the smallest blocks that keep a frame within the point budget. */
+	PointBudget,
+};
+
+/** Everything needed to turn a Z16 depth frame into points, mirrors the Depth properties on the actors. */
+struct FDepthConversionParams
+{
+	int32 Width = 0;
+	int32 Height = 0;
+	float DepthScale = 0.001f;
+	float ScaleX = 0.002227171492f;
+	float ScaleY = 0.002325581395f;
+	float DepthMin = 0;
+	float DepthMax = 10;
+
+	/** Points outside [DepthMin, DepthMax] are invalid, like pixels without depth (0). */
+	bool bClipDepth = true;
+
+	/** Row bands converted in parallel on the task graph, 0 uses one per worker thread. */
+	int32 NumWorkers = 0;
+
+	/** Incremental conversion: largest raw depth / per channel color difference a pixel may drift and still count as unchanged. */
+	int32 DirtyDepthThreshold = 0;
+	int32 DirtyColorThreshold = 0;
+
+	/** Downsampling done by FPointCloudConverter::Decimate, block size N and the pixel budget for PointBudget. */
+	EDepthDecimation Decimation = EDepthDecimation::None;
+	int32 DecimationFactor = 2;
+	int32 PointBudget = 0;
+
+	/** Shift of the optical center in pixels, set on decimated frames so their rays go through the sampled pixels. */
+	float CenterOffsetX = 0;
+	float CenterOffsetY = 0;
+
+	/** Pixel (i, j) of this frame is (i, j) * PixelStep + PixelOffset in the frame a deprojection is defined for. */
+	float PixelStep = 1;
+	float PixelOffsetX = 0;
+	float PixelOffsetY = 0;
+
+	/** Per pixel ray factors, Width * Height each. Set by the converter from its ray table, rays are computed from ScaleX/ScaleY otherwise. */
+	const float* RayTableX = nullptr;
+	const float* RayTableY = nullptr;
+};
+
+/** Deprojects pixel (U, V) of the full resolution frame to the camera space ray (OutX, OutY, 1). */
+typedef TFunction<void(float U, float V, float& OutX, float& OutY)> FDepthDeprojection;
+
+/**
+* Depth + color to point cloud conversion shared by ARealSenseHandler and AMediaReader.
+* Color is RGBA8 and has to be aligned to the depth frame (same resolution).
+*/
+class SIMLY_API FPointCloudConverter
+{
+public:
+	/** Converts a whole frame into a dense Points, resized to Width * Height with a validity mask. Rows are split over NumWorkers bands. */
+	void Convert(const FDepthConversionParams& Params, const uint16* Depth, const uint32* Color, FPointCloudBuffer& Points);
+
+	/** Converts rows [RowBegin, RowEnd), Points holds Width * Height points in row major order. */
+	static void ConvertRows(const FDepthConversionParams& Params, const uint16* Depth, const uint32* Color, FPointCloudBuffer& Points, int32 RowBegin, int32 RowEnd);
+
+	/** Converts the rectangle [RowBegin, RowEnd) x [ColBegin, ColEnd). */
+	static void ConvertRect(const FDepthConversionParams& Params, const uint16* Depth, const uint32* Color, FPointCloudBuffer& Points, int32 RowBegin, int32 RowEnd, int32 ColBegin, int32 ColEnd);
+
+	/**
+	* Converts only the valid pixels, so Points holds no placeholders for missing depth. Valid pixels are counted
+	* per band first, every band then writes its own slice of Points. OutBounds is the box around the points.
+	*/
+	void ConvertCompact(const FDepthConversionParams& Params, const uint16* Depth, const uint32* Color, FPointCloudBuffer& Points, FBox& OutBounds);
+
+	/** Copies the valid points of a dense (Width * Height) conversion into Points. */
+	void Compact(const FDepthConversionParams& Params, const FPointCloudBuffer& Dense, FPointCloudBuffer& Points, FBox& OutBounds);
+
+	/** Number of valid pixels in rows [RowBegin, RowEnd). */
+	static int32 CountValid(const FDepthConversionParams& Params, const uint16* Depth, int32 RowBegin, int32 RowEnd);
+
+	/** Converts the valid pixels of rows [RowBegin, RowEnd) back to back into Points from Offset and grows Bounds, returns the number written. */
+	static int32 ConvertRowsCompact(const FDepthConversionParams& Params, const uint16* Depth, const uint32* Color, FPointCloudBuffer& Points, int32 Offset, int32 RowBegin, int32 RowEnd, FBox& Bounds);
+
+	/**
+	* Replaces the contents of Cloud with Points, converted to LiDAR points in LidarPoints. CloudBounds is the box
+	* the cloud was last initialized with and only ever grows (with some headroom). While it holds, the existing
+	* octree is emptied and refilled instead of rebuilt; reset it to an invalid box after initializing Cloud elsewhere.
+	*
+	* Every point is reinserted on the calling thread, so the cost follows the frame size. Incremental conversion
+	* only saves the conversion of unchanged tiles and the whole upload of unchanged frames.
+	*/
+	static void Upload(ULidarPointCloud* Cloud, const FPointCloudBuffer& Points, TArray<FLidarPointCloudPoint>& LidarPoints, const FBox& PointsBounds, FBox& CloudBounds);
+
+	/**
+	* Downsamples Depth and Color into buffers owned by the converter when Params asks for decimation, and points
+	* them there. Returns the params to convert the result with, Params itself when nothing was done.
+	*/
+	FDepthConversionParams Decimate(const FDepthConversionParams& Params, const uint16*& Depth, const uint32*& Color);
+
+	/** Block size Decimate uses for Params, 1 when it leaves the frame alone. */
+	static int32 GetDecimationFactor(const FDepthConversionParams& Params);
+
+	/** Number of row bands Convert splits a frame into. */
+	static int32 GetNumBands(const FDepthConversionParams& Params);
+
+	/**
+	* Like Convert, but only converts the tiles Points is missing. The converter keeps the input each tile was
+	* last converted from, tiles that moved beyond the dirty thresholds since are reconverted. Tile rows are split
+	* over NumWorkers bands.
+	*
+	* PointsVersion says what Points currently holds and is updated, keep one per output array (0 = unknown).
+	* Returns false when no tile changed since the previous call, the previous frame can be reused as is.
+	*/
+	bool ConvertIncremental(const FDepthConversionParams& Params, const uint16* Depth, const uint32* Color, FPointCloudBuffer& Points, uint32& PointsVersion);
+
+	/**
+	* Rays come from Deprojection (e.g. the stream intrinsics, distortion included) instead of ScaleX/ScaleY,
+	* an empty function goes back to the scale model. Call it again when the stream profile changes.
+	*/
+	void SetDeprojection(FDepthDeprojection InDeprojection);
+
+	bool HasDeprojection() const { return (bool)Deprojection; }
+
+	/** Makes the next incremental conversion treat every tile as changed. */
+	void ResetTiles();
+
+	int32 GetNumTiles() const { return TileVersions.Num(); }
+	int32 GetNumDirtyTiles() const { return NumDirtyTiles; }
+
+private:
+	// Input each tile was last converted from, and the version it changed at
+	TArray<uint16> ReferenceDepth;
+	TArray<uint32> ReferenceColor;
+	TArray<uint32> TileVersions;
+	FDepthConversionParams ReferenceParams;
+	uint32 Version = 0;
+	int32 NumDirtyTiles = 0;
+
+	// Returns Params pointing at the ray table, rebuilt first when Params or the deprojection changed
+	FDepthConversionParams UpdateRays(const FDepthConversionParams& Params);
+
+	FDepthDeprojection Deprojection;
+	TArray<float> RayTableX;
+	TArray<float> RayTableY;
+	FDepthConversionParams RayParams;
+	bool bRaysValid = false;
+
+	// Output of Decimate
+	TArray<uint16> DecimatedDepth;
+	TArray<uint32> DecimatedColor;
+
+	// Compaction scratch, per band output offsets and bounds
+	TArray<int32> BandOffsets;
+	TArray<FBox> BandBounds;
+};
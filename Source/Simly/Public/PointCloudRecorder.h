@@ -0,0 +1,112 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "HAL/ThreadSafeBool.h"
+#include "HAL/ThreadSafeCounter.h"
+#include "Containers/Queue.h"
+#include "Async/Future.h"
+#include "PointCloudVideoWriter.h"
+
+class IFileHandle;
+
+/**
+* Records depth + color frames to a v2 point cloud video from a background thread.
+*
+* SubmitFrame copies the frame into one of a few preallocated slots and returns, the recorder thread
+* encodes it with an FPointCloudVideoWriter. The writer's bytes are staged in two 4 KB aligned buffers,
+* one is written to disk on the thread pool while the other fills up. When every slot is still queued
+* the frame is dropped.
+*/
+class SIMLY_API FPointCloudRecorder : public FRunnable
+{
+public:
+	FPointCloudRecorder() {}
+	virtual ~FPointCloudRecorder();
+
+	bool Open(const FString& FileName, EPointCloudVideoCodec InDepthCodec, EPointCloudVideoCodec InColorCodec, int32 InColorQuality = 85, int32 NumSlots = 2);
+
+	/** Finishes all queued frames, writes the index and closes the file. */
+	void Close();
+
+	bool IsRecording() const { return bAccepting; }
+
+	/**
+	* Safe to call from one capture thread while recording. The first frame decides the resolution,
+	* timestamps are in milliseconds and rebased so the first frame is at 0.
+	*/
+	bool SubmitFrame(uint64 Timestamp, int32 Width, int32 Height, const uint16* Depth, const uint32* Color);
+
+	int32 GetRecordedFrames() const { return RecordedFrames.GetValue(); }
+	int32 GetDroppedFrames() const { return DroppedFrames.GetValue(); }
+
+	// FRunnable
+	virtual uint32 Run() override;
+	virtual void Stop() override { bStopping = true; }
+
+private:
+	struct FFrameSlot
+	{
+		uint64 Timestamp = 0;
+		int32 Width = 0;
+		int32 Height = 0;
+		TArray<uint16> Depth;
+		TArray<uint32> Color;
+	};
+
+	/** Double buffered staging in front of the file, written to disk on the thread pool. */
+	class FStagingSink : public IPointCloudVideoSink
+	{
+	public:
+		virtual ~FStagingSink() { Reset(nullptr); }
+
+		/** Takes ownership of InFileHandle, nullptr frees the buffers and closes the current file. */
+		void Reset(IFileHandle* InFileHandle);
+
+		virtual bool Write(const void* Data, int64 Size) override;
+		virtual bool Flush() override;
+
+	private:
+		void SubmitStaging();
+		void WaitForPendingWrite();
+
+		IFileHandle* FileHandle = nullptr;
+		uint8* Staging[2] = {};
+		int64 StagingUsed = 0;
+		int32 ActiveStaging = 0;
+		TFuture<bool> PendingWrite;
+		bool bWriteFailed = false;
+	};
+
+	void WriteFrame(const FFrameSlot& Slot);
+
+	TUniquePtr<FRunnableThread> Thread;
+	FEvent* WorkEvent = nullptr;
+	FThreadSafeBool bAccepting;
+	FThreadSafeBool bStopping;
+	FThreadSafeCounter RecordedFrames;
+	FThreadSafeCounter DroppedFrames;
+
+	// Capture side, slots travel between the queues
+	FCriticalSection SubmitMx;
+	TArray<FFrameSlot> Slots;
+	TQueue<int32, EQueueMode::Spsc> ReadySlots;
+	TQueue<int32, EQueueMode::Spsc> FreeSlots;
+	uint64 FirstTimestamp = 0;
+	bool bHasFirstFrame = false;
+
+	// Recorder thread, the writer is opened with the first frame's resolution
+	FStagingSink Sink;
+	FPointCloudVideoWriter Writer;
+	EPointCloudVideoCodec DepthCodec = EPointCloudVideoCodec::RVL;
+	EPointCloudVideoCodec ColorCodec = EPointCloudVideoCodec::Jpeg;
+	int32 ColorQuality = 85;
+};
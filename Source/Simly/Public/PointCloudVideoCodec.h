@@ -0,0 +1,44 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PointCloudVideoFormat.h"
+
+class IImageWrapper;
+
+/**
+* Frame compression for point cloud videos.
+*
+* Depth is Raw or RVL (see RVLCodec.h), color is Raw or Jpeg through
+* the engine's ImageWrapper module. An instance keeps its image wrapper around between frames, so use
+* one per thread.
+*/
+class SIMLY_API FPointCloudVideoCodec
+{
+public:
+	static bool IsDepthCodec(EPointCloudVideoCodec Codec) { return Codec == EPointCloudVideoCodec::Raw || Codec == EPointCloudVideoCodec::RVL; }
+	static bool IsColorCodec(EPointCloudVideoCodec Codec) { return Codec == EPointCloudVideoCodec::Raw || Codec == EPointCloudVideoCodec::Jpeg; }
+
+	bool EncodeDepth(EPointCloudVideoCodec Codec, const uint16* Depth, int32 NumPixels, TArray<uint8>& OutData);
+	bool DecodeDepth(EPointCloudVideoCodec Codec, const uint8* Data, int32 Size, uint16* OutDepth, int32 NumPixels);
+
+	/** Quality is 1-100 and only used by Jpeg. */
+	bool EncodeColor(EPointCloudVideoCodec Codec, const uint32* Color, int32 Width, int32 Height, int32 Quality, TArray<uint8>& OutData);
+	bool DecodeColor(EPointCloudVideoCodec Codec, const uint8* Data, int32 Size, uint32* OutColor, int32 Width, int32 Height);
+
+	static void EncodeRVL(const uint16* Depth, int32 NumPixels, TArray<uint8>& OutData);
+	static bool DecodeRVL(const uint8* Data, int32 Size, uint16* OutDepth, int32 NumPixels);
+
+private:
+	IImageWrapper* GetJpegWrapper();
+
+	TSharedPtr<IImageWrapper> JpegWrapper;
+	TArray64<uint8> RawColor;
+};
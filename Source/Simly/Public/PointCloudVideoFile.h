@@ -0,0 +1,80 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PointCloudVideoFormat.h"
+
+class IFileHandle;
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/** One frame of a point cloud video, the pointers stay valid until the next GetFrame or Close. */
+struct FPointCloudVideoFrame
+{
+	uint64 Timestamp = 0;
+	const uint8* Depth = nullptr;
+	uint32 DepthSize = 0;
+	const uint8* Color = nullptr;
+	uint32 ColorSize = 0;
+};
+
+/**
+* Random access reader for v1 and v2 point cloud videos.
+*
+* The file is memory mapped where the platform supports it, so frames are handed out straight
+* from the page cache. Otherwise each frame is read into a scratch buffer.
+*/
+class SIMLY_API FPointCloudVideoFile
+{
+public:
+	FPointCloudVideoFile() {}
+	~FPointCloudVideoFile();
+
+	bool Open(const FString& FileName);
+	void Close();
+	bool IsOpen() const { return MappedRegion != nullptr || FileHandle != nullptr; }
+
+	uint32 GetVersion() const { return Version; }
+	int32 GetWidth() const { return Width; }
+	int32 GetHeight() const { return Height; }
+	EPointCloudVideoCodec GetDepthCodec() const { return DepthCodec; }
+	EPointCloudVideoCodec GetColorCodec() const { return ColorCodec; }
+
+	int32 NumFrames() const { return Index.Num(); }
+	uint64 GetTimestamp(int32 Frame) const { return Index[Frame].Timestamp; }
+	uint64 GetDuration() const { return Index.Num() > 0 ? Index.Last().Timestamp : 0; }
+
+	/** Last frame at or before Timestamp, 0 when Timestamp precedes the first frame. */
+	int32 FindFrame(uint64 Timestamp) const;
+
+	bool GetFrame(int32 Frame, FPointCloudVideoFrame& OutFrame);
+
+private:
+	/** Returns Length bytes at Offset, or nullptr when they are outside the file. */
+	const uint8* Fetch(int64 Offset, int64 Length);
+
+	bool ReadIndex();
+	bool ScanFrames(int64 Offset);
+
+	IMappedFileHandle* MappedHandle = nullptr;
+	IMappedFileRegion* MappedRegion = nullptr;
+	const uint8* MappedData = nullptr;
+	IFileHandle* FileHandle = nullptr;
+	TArray<uint8> Scratch;
+	int64 FileSize = 0;
+
+	uint32 Version = 0;
+	int32 Width = 0;
+	int32 Height = 0;
+	EPointCloudVideoCodec DepthCodec = EPointCloudVideoCodec::Raw;
+	EPointCloudVideoCodec ColorCodec = EPointCloudVideoCodec::Raw;
+	int64 FrameHeaderSize = 0;
+	TArray<FPointCloudVideoIndexEntry> Index;
+};
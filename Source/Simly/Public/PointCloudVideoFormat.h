@@ -0,0 +1,87 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/*
+	Point cloud video container, as read by AMediaReader.
+
+	v1: FPointCloudVideoHeaderV1, then frames of [uint64 timestamp][uint16 depth * W*H][RGBA8 color * W*H].
+
+	v2: FPointCloudVideoHeader, then frames of [FPointCloudVideoFrameHeader][depth][color], then one
+	    FPointCloudVideoIndexEntry per frame and an FPointCloudVideoTrailer as the last bytes of the file.
+	    A file without trailer (recording interrupted) is recovered by walking the frame headers.
+	    Depth and color are stored with the codecs named in the header, see FPointCloudVideoCodec.
+
+	All values are little endian, timestamps are milliseconds since the start of the recording.
+*/
+
+#define POINTCLOUD_VIDEO_MAGIC 0x56435053 // "SPCV"
+#define POINTCLOUD_VIDEO_VERSION 2
+
+enum class EPointCloudVideoCodec : uint8
+{
+	/** Uncompressed Z16 depth or RGBA8 color. */
+	Raw = 0,
+
+	/** Lossless run length + variable length delta coding for depth. */
+	RVL = 1,
+
+	/** Lossy JPEG for color. */
+	Jpeg = 2,
+};
+
+struct FPointCloudVideoHeaderV1
+{
+	uint32 Width;
+	uint32 Height;
+	uint32 Encryption;
+};
+
+struct FPointCloudVideoHeader
+{
+	uint32 Magic = POINTCLOUD_VIDEO_MAGIC;
+	uint32 Version = POINTCLOUD_VIDEO_VERSION;
+	uint32 Width = 0;
+	uint32 Height = 0;
+	EPointCloudVideoCodec DepthCodec = EPointCloudVideoCodec::Raw;
+	EPointCloudVideoCodec ColorCodec = EPointCloudVideoCodec::Raw;
+	uint8 Reserved[14] = {};
+};
+
+struct FPointCloudVideoFrameHeader
+{
+	uint64 Timestamp;
+	uint32 DepthSize;
+	uint32 ColorSize;
+};
+
+struct FPointCloudVideoIndexEntry
+{
+	uint64 Timestamp;
+
+	/** File offset of the frame header. */
+	uint64 Offset;
+	uint32 DepthSize;
+	uint32 ColorSize;
+};
+
+struct FPointCloudVideoTrailer
+{
+	uint64 IndexOffset;
+	uint32 NumFrames;
+	uint32 Magic;
+};
+
+static_assert(sizeof(FPointCloudVideoHeaderV1) == 12, "v1 header layout changed");
+static_assert(sizeof(FPointCloudVideoHeader) == 32, "v2 header layout changed");
+static_assert(sizeof(FPointCloudVideoFrameHeader) == 16, "Frame header layout changed");
+static_assert(sizeof(FPointCloudVideoIndexEntry) == 24, "Index entry layout changed");
+static_assert(sizeof(FPointCloudVideoTrailer) == 16, "Trailer layout changed");
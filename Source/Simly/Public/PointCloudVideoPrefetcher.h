@@ -0,0 +1,89 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "HAL/ThreadSafeBool.h"
+#include "Containers/Queue.h"
+#include "PointCloudVideoFile.h"
+#include "PointCloudVideoCodec.h"
+
+/** A decoded frame waiting in the prefetch ring. */
+struct FPrefetchedFrame
+{
+	int32 Frame = INDEX_NONE;
+	uint32 Generation = 0;
+	bool bValid = false;
+	TArray<uint16> Depth;
+	TArray<uint32> Color;
+};
+
+/**
+* Reads and decodes the frames of a point cloud video ahead of playback on a background thread.
+*
+* Frames are read in order into a fixed ring of slots, so at most NumSlots frames are buffered and
+* the memory is reused. The consumer takes slots with Acquire and hands them back with Release.
+* Asking for a frame that isn't next in line restarts reading there, everything read before is
+* thrown away.
+*
+* While open, the prefetcher is the only one allowed to call GetFrame on the video. Acquire,
+* Release and Seek must all be called from one consumer thread.
+*/
+class SIMLY_API FPointCloudVideoPrefetcher : public FRunnable
+{
+public:
+	FPointCloudVideoPrefetcher() {}
+	virtual ~FPointCloudVideoPrefetcher();
+
+	bool Open(FPointCloudVideoFile* InVideo, int32 NumSlots, int32 FirstFrame = 0);
+	void Close();
+
+	/** Wrap around to the first frame after the last one. */
+	void SetLoop(bool bInLoop) { bLoop = bInLoop; }
+
+	/** Continue reading at Frame, slots read before are discarded. */
+	void Seek(int32 Frame);
+
+	/**
+	* Slot holding Frame, waits up to WaitMs for it to be read. Frames before it are skipped.
+	* Returns INDEX_NONE when the frame isn't ready yet.
+	*/
+	int32 Acquire(int32 Frame, uint32 WaitMs);
+	const FPrefetchedFrame& GetSlot(int32 SlotIndex) const { return Slots[SlotIndex]; }
+	void Release(int32 SlotIndex);
+
+	// FRunnable
+	virtual uint32 Run() override;
+	virtual void Stop() override { bStopping = true; }
+
+private:
+	bool ReadFrame(int32 Frame, FPrefetchedFrame& Slot);
+
+	FPointCloudVideoFile* Video = nullptr;
+	TUniquePtr<FRunnableThread> Thread;
+	FEvent* WorkEvent = nullptr;
+	FEvent* ReadyEvent = nullptr;
+	FThreadSafeBool bStopping;
+	volatile bool bLoop = false;
+
+	// Slots travel between the queues, the prefetch thread fills them and the consumer frees them
+	TArray<FPrefetchedFrame> Slots;
+	TQueue<int32, EQueueMode::Spsc> ReadySlots;
+	TQueue<int32, EQueueMode::Spsc> FreeSlots;
+
+	// Next frame to read, a seek bumps the generation so slots from before it can be told apart
+	FCriticalSection SeekMx;
+	int32 NextFrame = 0;
+	uint32 Generation = 0;
+
+	// Prefetch thread
+	FPointCloudVideoCodec Codec;
+};
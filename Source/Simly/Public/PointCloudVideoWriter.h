@@ -0,0 +1,86 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PointCloudVideoFormat.h"
+#include "PointCloudVideoCodec.h"
+
+/** Destination of a point cloud video's bytes, written strictly in file order. */
+class SIMLY_API IPointCloudVideoSink
+{
+public:
+	virtual ~IPointCloudVideoSink() {}
+
+	/** Returns false once the bytes can't be stored, the writer stops writing frames then. */
+	virtual bool Write(const void* Data, int64 Size) = 0;
+
+	/** Called by FPointCloudVideoWriter::Close after the trailer. */
+	virtual bool Flush() = 0;
+};
+
+/**
+* Writes v2 point cloud videos that AMediaReader can play back, the only code that lays out that format.
+*
+* Frames are compressed on the calling thread and handed to a sink, either a file written on the
+* calling thread or one the caller provides (FPointCloudRecorder stages them for async disk writes).
+* Close appends the frame index.
+*/
+class SIMLY_API FPointCloudVideoWriter
+{
+public:
+	FPointCloudVideoWriter() {}
+	~FPointCloudVideoWriter();
+
+	bool Open(const FString& FileName, int32 InWidth, int32 InHeight,
+		EPointCloudVideoCodec InDepthCodec = EPointCloudVideoCodec::RVL,
+		EPointCloudVideoCodec InColorCodec = EPointCloudVideoCodec::Jpeg,
+		int32 InColorQuality = 85);
+
+	/** Writes into InSink, which has to stay alive until Close. */
+	bool Open(IPointCloudVideoSink& InSink, int32 InWidth, int32 InHeight,
+		EPointCloudVideoCodec InDepthCodec = EPointCloudVideoCodec::RVL,
+		EPointCloudVideoCodec InColorCodec = EPointCloudVideoCodec::Jpeg,
+		int32 InColorQuality = 85);
+
+	/** Depth is Width * Height Z16 values, Color Width * Height RGBA8 pixels. */
+	bool WriteFrame(uint64 Timestamp, const uint16* Depth, const uint32* Color);
+
+	/** Writes the index and trailer, a file that is never closed can still be played back by scanning. */
+	bool Close();
+
+	bool IsOpen() const { return Sink != nullptr; }
+
+	/** The sink refused a write, no further frames are written. */
+	bool HasFailed() const { return bFailed; }
+
+	int32 GetWidth() const { return Width; }
+	int32 GetHeight() const { return Height; }
+	int32 NumFrames() const { return Index.Num(); }
+	int64 GetBytesWritten() const { return Offset; }
+
+private:
+	bool Write(const void* Data, int64 Size);
+
+	IPointCloudVideoSink* Sink = nullptr;
+	TUniquePtr<IPointCloudVideoSink> OwnedSink;
+	FPointCloudVideoCodec Codec;
+	TArray<uint8> DepthData;
+	TArray<uint8> ColorData;
+	TArray<FPointCloudVideoIndexEntry> Index;
+	int64 Offset = 0;
+	bool bFailed = false;
+
+	int32 Width = 0;
+	int32 Height = 0;
+	EPointCloudVideoCodec DepthCodec = EPointCloudVideoCodec::RVL;
+	EPointCloudVideoCodec ColorCodec = EPointCloudVideoCodec::Jpeg;
+	int32 ColorQuality = 85;
+};
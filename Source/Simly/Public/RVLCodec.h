@@ -0,0 +1,88 @@
+#pragma once
+#include <cstddef> // size_t
+#include <cstring> // memcpy
+
+/*
+    RVL lossless depth compression (Wilson, "Fast Lossless Depth Image Compression").
+
+    Alternating runs of zero (invalid) and non zero pixels, non zero pixels as zigzag deltas to
+    their predecessor. Every value is written as 4 bit nibbles (3 value bits + continuation),
+    packed into 32 bit words from the top and stored little endian.
+
+    Engine independent so the standalone benchmarks can check it, FPointCloudVideoCodec wraps it.
+*/
+
+namespace RVL {
+    static_assert(sizeof(unsigned int) == 4, "RVL packs nibbles into 32 bit words");
+
+    // Longest value the encoder writes, 32 bits in 3 bit nibbles
+    static const int MaxNibblesPerValue = 11;
+
+    template <class Append> class Writer {
+    public:
+        explicit Writer(Append &_append) : append(_append) {}
+
+        void put(unsigned int value) {
+            do {
+                unsigned int nibble = value & 0x7;
+                value >>= 3;
+                if (value)
+                    nibble |= 0x8;
+
+                word = (word << 4) | nibble;
+                if (++nibbles == 8)
+                    flush();
+            } while (value);
+        }
+
+        void finish() {
+            if (nibbles == 0)
+                return;
+            word <<= 4 * (8 - nibbles);
+            flush();
+        }
+
+    private:
+        void flush() {
+            unsigned char bytes[sizeof(word)];
+            memcpy(bytes, &word, sizeof(word));
+            append((const unsigned char *)bytes, sizeof(bytes));
+            word = 0;
+            nibbles = 0;
+        }
+
+        Append &append;
+        unsigned int word = 0;
+        int nibbles = 0;
+    };
+
+    // Encodes numPixels depth values, append(const unsigned char *bytes, size_t length) receives whole words
+    template <class Append> void encode(const unsigned short *depth, size_t numPixels, Append &&append) {
+        Writer<Append> writer(append);
+        const unsigned short *end = depth + numPixels;
+        int previous = 0;
+
+        while (depth != end) {
+            const unsigned short *start = depth;
+            while (depth != end && *depth == 0)
+                ++depth;
+            writer.put((unsigned int)(depth - start));
+
+            start = depth;
+            while (depth != end && *depth != 0)
+                ++depth;
+            writer.put((unsigned int)(depth - start));
+
+            for (; start != depth; ++start) {
+                const int delta = (int)*start - previous;
+                writer.put(((unsigned int)delta << 1) ^ (unsigned int)(delta >> 31));
+                previous = *start;
+            }
+        }
+
+        writer.finish();
+    }
+
+    // False when data is truncated or malformed, outDepth may be partially written then
+    bool decode(const unsigned char *data, size_t size, unsigned short *outDepth, size_t numPixels) noexcept;
+}
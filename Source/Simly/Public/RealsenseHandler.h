@@ -13,6 +13,7 @@
 #include "Misc/FileHelper.h"
 #include "Misc/Paths.h"
 #include "Misc/DateTime.h"
+#include "Containers/TripleBuffer.h"
 
 #include <map>
 #include <string>
@@ -28,12 +29,22 @@
 #include "RealSenseTypes.h"
 
 #include "PointcloudInterface.h"
+#include "PointCloudConverter.h"
+#include "PointCloudRecorder.h"
+#include "VoxelAccumulator.h"
 
 #include "RealSenseHandler.generated.h"
 
 #pragma once
 DECLARE_LOG_CATEGORY_EXTERN(LogPointCloud, Log, All);
 
+/** Valid points converted on the capture thread, and the box around them. */
+struct FRealSenseCapturedFrame
+{
+	FPointCloudBuffer Points;
+	FBox Bounds = FBox(ForceInit);
+};
+
 UCLASS(ClassGroup = "Simly", BlueprintType)
 class SIMLY_API ARealSenseHandler : public AActor, public IPointCloudInterface
 {
@@ -67,12 +78,68 @@ public:
 	UPROPERTY(Category = "Simly", BlueprintReadOnly)
 		ULidarPointCloud* PointCloud;
 
-	UPROPERTY(Category = "Simly", BlueprintReadOnly)
-		TArray<FLidarPointCloudPoint> Points;
+	/** Points of the latest frame, converted from the internal buffer on every call. */
+	UFUNCTION(Category = "Simly", BlueprintCallable)
+		TArray<FLidarPointCloudPoint> GetPoints() const;
+
+	UFUNCTION(Category = "Simly", BlueprintPure)
+		int32 GetNumPoints() const;
 
 	UFUNCTION(Category = "Simly", BlueprintCallable)
 		void SavePointCloud();
 
+	// Scanning
+	/** In Append mode merge frames into a voxel grid instead of inserting every pixel of every frame. */
+	UPROPERTY(Category = "Scanning", BlueprintReadWrite, EditAnywhere)
+		bool bUseVoxelGrid = true;
+
+	/** Voxel edge length in world units, changing it restarts the scan. */
+	UPROPERTY(Category = "Scanning", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "0.01", UIMin = "0.1", UIMax = "100"))
+		float VoxelSize = 1.0f;
+
+	/** New voxels collected before they are inserted into the point cloud. */
+	UPROPERTY(Category = "Scanning", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1"))
+		int32 VoxelBatchSize = 16384;
+
+	/**
+	* Seconds between refreshes of voxels whose average moved since they were inserted (their sample count
+	* doubled). A refresh rebuilds the cloud from every voxel, 0 leaves them as inserted until it grows.
+	*/
+	UPROPERTY(Category = "Scanning", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "0"))
+		float VoxelRefreshInterval = 2.0f;
+
+	/** Insert the voxels collected so far into the point cloud, refreshing updated ones when VoxelRefreshInterval is due. */
+	UFUNCTION(Category = "Scanning", BlueprintCallable)
+		void FlushVoxels();
+
+	UFUNCTION(Category = "Scanning", BlueprintCallable)
+		void ClearVoxels();
+
+	UFUNCTION(Category = "Scanning", BlueprintPure)
+		int32 GetNumVoxels() const;
+
+	// Recording
+	/** Record the aligned depth + color stream to a point cloud video that AMediaReader can play back. */
+	UFUNCTION(Category = "Recording", BlueprintCallable)
+		bool StartRecording(FString FileName);
+
+	UFUNCTION(Category = "Recording", BlueprintCallable)
+		void StopRecording();
+
+	UFUNCTION(Category = "Recording", BlueprintPure)
+		int32 GetRecordedFrames() const;
+
+	/** Frames skipped because the recorder or the disk fell behind. */
+	UFUNCTION(Category = "Recording", BlueprintPure)
+		int32 GetDroppedRecordingFrames() const;
+
+	/** RVL depth and JPEG color, otherwise frames are stored raw. */
+	UPROPERTY(Category = "Recording", BlueprintReadWrite, EditAnywhere)
+		bool bCompressRecording = true;
+
+	UPROPERTY(Category = "Recording", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1", ClampMax = "100", UIMin = "1", UIMax = "100"))
+		int32 RecordingQuality = 85;
+
 	// Device
 	UPROPERTY(Category = "Device", BlueprintReadWrite, EditAnywhere)
 		ERealSensePipelineMode PipelineMode = ERealSensePipelineMode::CaptureOnly;
@@ -80,6 +147,14 @@ public:
 	UPROPERTY(Category = "Device", BlueprintReadWrite, EditAnywhere)
 		FString CaptureFile;
 
+	/** Wait for, align and convert frames on a background thread, PollFrame then only uploads the latest one. */
+	UPROPERTY(Category = "Device", BlueprintReadWrite, EditAnywhere)
+		bool bUseCaptureThread = true;
+
+	/** Upload the latest captured frame every tick, without needing PollFrame to be called. */
+	UPROPERTY(Category = "Device", BlueprintReadWrite, EditAnywhere)
+		bool bUpdateOnTick = false;
+
 	// Depth
 	UPROPERTY(Category = "Stream", BlueprintReadWrite, EditAnywhere)
 		FRealSenseStreamMode DepthConfig;
@@ -99,6 +174,41 @@ public:
 	UPROPERTY(Category = "Depth", BlueprintReadWrite, EditAnywhere)
 		float ScaleY = 0.002325581395f;
 
+	/** Deproject with the intrinsics (and distortion model) of the stream, ScaleX/ScaleY are only used when this is off. */
+	UPROPERTY(Category = "Depth", BlueprintReadWrite, EditAnywhere)
+		bool bUseStreamIntrinsics = true;
+
+	/** Row bands converted in parallel per frame, 0 uses one per task graph worker. */
+	UPROPERTY(Category = "Depth", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "0", UIMin = "0", UIMax = "64"))
+		int32 ConversionWorkers = 0;
+
+	/**
+	* Only convert the tiles of a frame that changed, and skip the upload when none did. A frame with any
+	* changed tile is still uploaded whole, the point cloud can't replace a tile's points in place.
+	*/
+	UPROPERTY(Category = "Depth", BlueprintReadWrite, EditAnywhere)
+		bool bIncrementalUpdate = true;
+
+	/** Raw depth units a pixel may drift before its tile is converted again. */
+	UPROPERTY(Category = "Depth", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "0", UIMin = "0", UIMax = "100"))
+		int32 DirtyDepthThreshold = 0;
+
+	/** Per channel color difference a pixel may drift before its tile is converted again. */
+	UPROPERTY(Category = "Depth", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "0", ClampMax = "255", UIMin = "0", UIMax = "64"))
+		int32 DirtyColorThreshold = 0;
+
+	/** Downsample frames before they are converted, recordings keep the full resolution. */
+	UPROPERTY(Category = "Depth", BlueprintReadWrite, EditAnywhere)
+		EDepthDecimation Decimation = EDepthDecimation::None;
+
+	/** Block size for Subsample and Median, 2 keeps a quarter of the points. */
+	UPROPERTY(Category = "Depth", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1", ClampMax = "8", UIMin = "1", UIMax = "8"))
+		int32 DecimationFactor = 2;
+
+	/** Most pixels a frame may convert to with PointBudget decimation. */
+	UPROPERTY(Category = "Depth", BlueprintReadWrite, EditAnywhere, meta = (ClampMin = "1"))
+		int32 PointBudget = 100000;
+
 	// Color
 	UPROPERTY(Category = "Stream", BlueprintReadWrite, EditAnywhere)
 		FRealSenseStreamMode ColorConfig;
@@ -111,10 +221,16 @@ protected:
 
 	virtual void Tick(float DeltaSeconds) override; 
 	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 private:
 
+	void ThreadProc();
 	void ProcessFrameset(class rs2::frameset* Frameset, FTransform Transform, bool Append);
+	bool ConvertFrameset(class rs2::frameset* Frameset, FPointCloudBuffer& OutPoints, FBox& OutBounds, bool bClipDepth);
+	void UploadPoints(FTransform Transform, bool Append);
+	bool ShouldClipDepth(bool Append) const;
+	bool IsVoxelRefreshDue() const;
 	void EnsureProfileSupported(class URealSenseDevice* Device, ERealSenseStreamType StreamType, ERealSenseFormatType Format, FRealSenseStreamMode Mode);
 
 	FCriticalSection StateMx;
@@ -123,15 +239,50 @@ private:
 	TUniquePtr<class rs2::device> RsDevice;
 	TUniquePtr<class rs2::align> RsAlign;
 
+	TUniquePtr<class FRealSenseHandlerWorker> Worker;
+	TUniquePtr<class FRunnableThread> Thread;
+
+	// Frames converted by the capture thread, the game thread only swaps buffers
+	TTripleBuffer<FRealSenseCapturedFrame> CapturedFrames;
+
 	volatile int StartedFlag = false;
+
+	// Clip flag for the capture thread, set from the Append mode PollFrame is called with
+	FThreadSafeBool bCaptureClipDepth = true;
 	volatile int FramesetId = 0;
 	bool FirstFrame = false;
 
-	struct rgba
-	{
-		uint8 r;
-		uint8 g;
-		uint8 b;
-		uint8 a;
-	};
+	FPointCloudConverter Converter;
+	rs2_intrinsics DepthIntrinsics;
+
+	// Latest frame, valid points only. Incremental conversion keeps a full frame with a validity mask
+	FPointCloudBuffer Points;
+	FPointCloudBuffer DensePoints;
+	uint32 DenseVersion = 0;
+
+	// Box around Points, and the one the cloud was last initialized with
+	FBox PointsBounds = FBox(ForceInit);
+	FBox CloudBounds = FBox(ForceInit);
+
+	// Points in the LiDAR layout, only filled right before they are handed to the point cloud
+	TArray<FLidarPointCloudPoint> LidarPoints;
+
+	FVoxelAccumulator Voxels;
+	TArray<FLidarPointCloudPoint> VoxelPoints;
+	FBox VoxelCloudBounds = FBox(ForceInit);
+	double LastVoxelRefresh = 0.0;
+	FPointCloudRecorder Recorder;
+};
+
+class FRealSenseHandlerWorker : public FRunnable
+{
+public:
+	FRealSenseHandlerWorker(ARealSenseHandler* Context) { this->Context = Context; }
+	virtual ~FRealSenseHandlerWorker() {}
+	virtual bool Init() { return true; }
+	virtual uint32 Run() { Context->ThreadProc(); return 0; }
+	virtual void Stop() { Context->StartedFlag = false; }
+
+private:
+	ARealSenseHandler* Context = nullptr;
 };
\ No newline at end of file
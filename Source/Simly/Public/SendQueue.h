@@ -0,0 +1,43 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Sockets.h"
+
+/**
+* Bounded outbound byte queue for one connection.
+*
+* Any thread may enqueue complete packets, only the server thread flushes. A flush sends
+* everything queued so far with one gather write and keeps whatever the socket didn't take.
+*/
+class SIMLY_API FSendQueue
+{
+public:
+	explicit FSendQueue(int32 InCapacity = 64 * 1024);
+
+	/** Copies a packet into the queue. Returns false and drops it if the backlog is full. */
+	bool Enqueue(const uint8* Data, int32 Length, bool& bOutWasEmpty);
+
+	/** Sends as much as the socket accepts without blocking. Returns false on a socket error. */
+	bool Flush(FSocket* Socket);
+
+	bool IsEmpty() const;
+	int32 Num() const;
+	int32 GetCapacity() const { return Ring.Num(); }
+	int32 GetDroppedPackets() const { return DroppedPackets.GetValue(); }
+
+private:
+	mutable FCriticalSection Mx;
+	TArray<uint8> Ring;
+	uint64 Mask;
+	uint64 Head = 0; // only advanced by Flush
+	uint64 Tail = 0; // only advanced by Enqueue
+	FThreadSafeCounter DroppedPackets;
+};
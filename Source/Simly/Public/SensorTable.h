@@ -0,0 +1,65 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ClientSocket.h"
+
+#include <atomic>
+
+/**
+* Latest force and rotator values per connected device, readable from any thread without locks.
+*
+* Every device gets a slot when it connects, the UID handed out encodes the slot and how often it was
+* reused, so a stale UID never reads the values of a newer device. Each slot is a seqlock: its one
+* writer (the device's I/O worker) bumps the sequence to odd, writes and bumps it back to even, readers
+* copy the values and retry when the sequence moved underneath them.
+*/
+class SIMLY_API FSensorTable
+{
+public:
+	enum { MaxDevices = 256 };
+
+	/** Claims a free slot, returns the device UID or INDEX_NONE when the table is full. Safe to call from several threads. */
+	int32 Register();
+	void Unregister(int32 Uid);
+
+	void WriteForce(int32 Uid, const FForceSensor& Force);
+	void WriteRotation(int32 Uid, const FRotatorSensor& Rotation);
+
+	/** False when the device is gone or hasn't sent this kind of sample yet. */
+	bool GetLatestForce(int32 Uid, FForceSensor& OutForce) const;
+	bool GetLatestRotation(int32 Uid, FRotatorSensor& OutRotation) const;
+
+private:
+	struct FValues
+	{
+		FForceSensor Force;
+		FRotatorSensor Rotation;
+		bool bHasForce = false;
+		bool bHasRotation = false;
+	};
+
+	struct alignas(PLATFORM_CACHE_LINE_SIZE) FSlot
+	{
+		std::atomic<uint32> Sequence{ 0 };
+		std::atomic<int32> Uid{ INDEX_NONE };
+		int32 Generation = 0;
+		FValues Values;
+	};
+
+	FSlot* FindSlot(int32 Uid);
+	const FSlot* FindSlot(int32 Uid) const;
+	static void BeginWrite(FSlot& Slot);
+	static void EndWrite(FSlot& Slot);
+	static bool Read(const FSlot& Slot, int32 Uid, FValues& OutValues);
+
+	FSlot Slots[MaxDevices];
+};
@@ -27,12 +27,107 @@
 #include "Components/ActorComponent.h"
 #include "Networking.h"
 #include "IPAddress.h"
+#include "Containers/Queue.h"
+#include "HAL/ThreadSafeCounter.h"
 #include "ClientSocket.h"
+#include "SocketPoller.h"
+#include "SensorTable.h"
+#include "SocketOptions.h"
 
 #include "ServerSocket.generated.h"
 
 DECLARE_LOG_CATEGORY_EXTERN(LogServer, Log, All);
 
+USTRUCT(BlueprintType)
+struct FSensorTransportStats
+{
+	GENERATED_USTRUCT_BODY()
+public:
+	/** Sensor events broadcast since the last reset. */
+	UPROPERTY(BlueprintReadOnly, Category = "Sensor Events")
+	int32 Events = 0;
+	/** Time from receiving the bytes to the delegate broadcast, over the last events. */
+	UPROPERTY(BlueprintReadOnly, Category = "Sensor Events")
+	float P50LatencyMs = 0;
+	UPROPERTY(BlueprintReadOnly, Category = "Sensor Events")
+	float P99LatencyMs = 0;
+	/** UDP only */
+	UPROPERTY(BlueprintReadOnly, Category = "Sensor Events")
+	int32 Datagrams = 0;
+	/** UDP only, datagrams missing from the sequence */
+	UPROPERTY(BlueprintReadOnly, Category = "Sensor Events")
+	int32 Dropped = 0;
+	/** UDP only, datagrams that arrived after a newer one and were ignored */
+	UPROPERTY(BlueprintReadOnly, Category = "Sensor Events")
+	int32 Reordered = 0;
+};
+
+/** Ring of the most recent latencies of one transport, game thread only. */
+struct FLatencyHistory
+{
+	TArray<float> Samples;
+	int32 Next = 0;
+	int32 Events = 0;
+
+	void Add(float Ms);
+	float GetPercentile(float Percentile) const;
+	void Reset();
+};
+
+/** A sensor sample waiting to be broadcast on the game thread. */
+struct FSensorEvent
+{
+	FString Client;
+	bool bRotation = false;
+	bool bDatagram = false;
+	uint64 ReceivedCycles = 0;
+	FForceSensor Force;
+	FRotatorSensor Rotation;
+};
+
+/** Sensor samples an I/O worker received since the last game tick. */
+struct FSensorEventBatch
+{
+	// Newest sample per sensor, keyed by client and rotator id (-1 for the force sensor)
+	TMap<TTuple<const ClientSocket*, int32>, FSensorEvent> Latest;
+
+	// Every sample in arrival order when SensorHistorySize > 0 or it came in a batch, the oldest are overwritten once it is full.
+	// Single and batched samples share one capacity
+	TArray<FSensorEvent> History;
+	int32 HistoryStart = 0;
+	int32 NumDropped = 0;
+
+	void Reset()
+	{
+		Latest.Reset();
+		History.Reset();
+		HistoryStart = 0;
+		NumDropped = 0;
+	}
+};
+
+/** One I/O worker thread with its own poller, serves the clients assigned to it for their whole connection. */
+struct FServerShard
+{
+	TUniquePtr<FSocketPoller> Poller;
+	TFuture<void> Finished;
+
+	// Worker thread only
+	TArray<TSharedPtr<ClientSocket, ESPMode::ThreadSafe>> Clients;
+
+	// Handed over by other threads
+	TQueue<TSharedPtr<ClientSocket, ESPMode::ThreadSafe>, EQueueMode::Mpsc> PendingAdds;
+	TQueue<TSharedPtr<ClientSocket, ESPMode::ThreadSafe>, EQueueMode::Mpsc> PendingFlushes;
+	TQueue<FString, EQueueMode::Mpsc> PendingDisconnects;
+
+	// Used by the accept thread to pick the least loaded worker
+	FThreadSafeCounter NumClients;
+
+	// Filled by the worker, swapped out once per game tick
+	FCriticalSection EventsMx;
+	FSensorEventBatch Events;
+};
+
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FTCPEventSignature);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FTCPMessageSignature, const TArray<uint8>&, Bytes);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FTCPClientSignature, const FString&, Client);
@@ -80,8 +175,12 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "TCP Connection Properties")
 	FString ListenSocketName;
 
-	/** in bytes */
+	/** Applied to the listen socket and every client socket, changes take effect on the next StartListenServer */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "TCP Connection Properties")
+	FServerSocketOptions SocketOptions;
+
+	/** in bytes, when set it is used for SocketOptions' receive and send buffer sizes that are still 0 */
+	UPROPERTY(BlueprintReadWrite, Category = "TCP Connection Properties", meta = (DeprecatedProperty, DeprecationMessage = "Use SocketOptions.ReceiveBufferSize and SocketOptions.SendBufferSize instead."))
 	int32 BufferMaxSize;
 
 	/** If true will auto-listen on begin play to port specified for receiving TCP messages. */
@@ -108,6 +207,34 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "TCP Connection Properties")
 	FString PingMessage;
 
+	/** Also accept sensor packets as UDP datagrams, for streams where only the newest sample counts */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "UDP Connection Properties")
+	bool bListenUdp;
+
+	/** 0 uses ListenPort */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "UDP Connection Properties")
+	int32 UdpPort;
+
+	/** Seconds without a datagram before a UDP device is forgotten */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "UDP Connection Properties")
+	float UdpPeerTimeout;
+
+	/** Client I/O threads, clients are spread over them on connect. 0 uses half the CPU cores */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "TCP Connection Properties", meta = (ClampMin = "0", UIMin = "0", UIMax = "16"))
+	int32 NumIOWorkers;
+
+	/** Per client outbound backlog in bytes, packets that don't fit are dropped instead of blocking the caller */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "TCP Connection Properties")
+	int32 SendQueueSize;
+
+	/**
+	* Above 0 every sensor sample is kept per I/O worker between two ticks and broadcast in arrival order,
+	* in a history of this many samples but at least 4096. 0 only broadcasts the newest sample of every
+	* sensor once per tick. Samples from force batch packets always go through the history.
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sensor Events", meta = (ClampMin = "0", UIMin = "0", UIMax = "65536"))
+	int32 SensorHistorySize;
+
 	UPROPERTY(BlueprintReadOnly, Category = "TCP Connection Properties")
 	bool bIsConnected;
 
@@ -131,26 +258,105 @@ public:
 	void DisconnectClient(FString ClientAddress = TEXT("All"), bool bDisconnectNextTick = false);
 
 	/**
-	* Send rotation request to specified client.
+	* Send rotation request to specified client. Clients that only send over UDP can not receive one, the request is dropped with a warning.
 	*/
 	UFUNCTION(BlueprintCallable, Category = "TCP Functions")
 	void SendRotationRequest(FString client, FRotatorSensor request);
 
+	/** UID of a connected client for the GetLatest functions, INDEX_NONE when it isn't connected. */
+	UFUNCTION(BlueprintPure, Category = "Sensor Values")
+	int32 GetClientUID(FString Client);
+
+	/** Newest force sample of a device, false when it is gone or hasn't sent one yet. */
+	UFUNCTION(BlueprintCallable, Category = "Sensor Values")
+	bool GetLatestForce(int32 UID, FForceSensor& Force) const;
+
+	/** Newest rotator sample of a device, false when it is gone or hasn't sent one yet. */
+	UFUNCTION(BlueprintCallable, Category = "Sensor Values")
+	bool GetLatestRotation(int32 UID, FRotatorSensor& Rotation) const;
+
+	/** Event counts and receive-to-broadcast latency of the TCP or UDP sensor path. */
+	UFUNCTION(BlueprintPure, Category = "Sensor Events")
+	FSensorTransportStats GetTransportStats(bool bUdp) const;
+
+	UFUNCTION(BlueprintCallable, Category = "Sensor Events")
+	void ResetTransportStats();
+
+	/** Lock-free sensor values, safe to poll from any thread while the server runs. */
+	const FSensorTable& GetSensorTable() const { return Sensors; }
+
+	/**
+	* I/O worker side, publishes the client's current force or rotator value: to the sensor table
+	* right away and to the delegates on the next tick.
+	*/
+	void QueueSensorEvent(const ClientSocket& Client, bool bRotation);
+
+	/**
+	* I/O worker side, decodes a RecvForceBatch body straight into the history in one pass and leaves
+	* the newest sample as the client's force value. Returns false for a malformed packet.
+	*/
+	bool QueueForceBatch(ClientSocket& Client, BufferView& Packet);
+
+	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 	virtual void InitializeComponent() override;
 	virtual void UninitializeComponent() override;
 	virtual void BeginPlay() override;
 	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 	
 protected:
-	TMap<FString, TSharedPtr<ClientSocket>> Clients;
+	TMap<FString, TSharedPtr<ClientSocket, ESPMode::ThreadSafe>> Clients;
+	FCriticalSection ClientsMx;
 	FSocket* ListenSocket;
 	FThreadSafeBool bShouldListen;
+	FThreadSafeBool bShouldServe;
 	TFuture<void> ServerFinishedFuture;
 
+	// Readiness wait for the listen socket, owned by the accept thread
+	TUniquePtr<FSocketPoller> Poller;
+
+	// Client I/O workers, a client's Shard indexes into this
+	TArray<TUniquePtr<FServerShard>> Shards;
+
+	// Latest value of every device, written by the I/O workers
+	FSensorTable Sensors;
+
+	// Datagram ingest, its own thread owns the socket and the UDP peers
+	FSocket* UdpSocket;
+	TFuture<void> UdpFinishedFuture;
+	FThreadSafeCounter UdpDatagrams;
+	FThreadSafeCounter UdpDropped;
+	FThreadSafeCounter UdpReordered;
+
+	// UDP peers belong to no I/O worker, DisconnectClient hands them to the datagram thread
+	TQueue<FString, EQueueMode::Mpsc> UdpPendingDisconnects;
+
+	// Filled by the datagram thread, swapped out once per game tick like a worker's
+	FCriticalSection UdpEventsMx;
+	FSensorEventBatch UdpEvents;
+
 	FString SocketDescription;
 	TSharedPtr<FInternetAddr> RemoteAdress;
 
 private:
+	void AcceptPendingClients();
+	void RunShard(FServerShard& Shard);
+	bool FlushClient(FServerShard& Shard, ClientSocket* Client);
+	void RemoveClient(FServerShard& Shard, const FString& Address);
+	FTimespan RunPingLogic(FServerShard& Shard);
+	void DispatchSensorEvents();
+	FSensorEvent& AddSensorEvent(FSensorEventBatch& Batch, const ClientSocket& Client, bool bRotation, bool bKeepHistory);
+	bool StartUdpListener(int32 Port);
+	void RunUdpListener();
+	int32 PickShard() const;
+	void HandleDatagram(ClientSocket& Peer, const uint8* Data, int32 Size);
+
+	// Game thread, receive-to-broadcast latency per transport
+	FLatencyHistory TcpLatency;
+	FLatencyHistory UdpLatency;
+
+	// Game thread scratch for the batch taken from a worker
+	FSensorEventBatch DrainedEvents;
+
 	static TFuture<void> RunLambdaOnBackGroundThread(TFunction< void()> InFunction)
 	{
 		return Async(EAsyncExecution::Thread, InFunction);
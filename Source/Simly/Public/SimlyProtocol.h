@@ -0,0 +1,234 @@
+#pragma once
+#include "Buffer.h"
+#include "PacketFramer.h"
+
+/*
+    Wire format of the Simly device protocol. Every packet is a uint16 LE body length
+    followed by a uint16 LE packet id and the payload.
+
+    Kept free of engine types so it can be used outside the editor (see Benchmarks/).
+*/
+
+namespace SimlyProtocol {
+    // Device -> server
+    enum RecvOpcode : unsigned short {
+        RecvPong = 0x01,
+        RecvForceSensor = 0x02,
+        RecvRotator = 0x03,
+        RecvForceBatch = 0x04,
+        RecvHandshake = 0xF0,
+    };
+
+    // Server -> device
+    enum SendOpcode : unsigned short {
+        SendPing = 0x01,
+        SendRotationRequest = 0x02,
+    };
+
+    struct ForceSample {
+        unsigned int front = 0;
+        unsigned int back = 0;
+        unsigned int left = 0;
+        unsigned int right = 0;
+    };
+
+    struct RotatorSample {
+        unsigned short type = 0;
+        unsigned short id = 0;
+        int rotation = 0;
+    };
+
+    // One entry of a RecvForceBatch packet
+    struct ForceBatchSample {
+        unsigned int timestamp = 0; // device clock in microseconds
+        ForceSample force;
+    };
+
+    enum ForceBatchFlags : unsigned char {
+        // Samples after the first are stored as 16 bit steps from the previous one
+        ForceBatchDelta = 1 << 0,
+    };
+
+    // Sample count (uint16) and flags (uint8)
+    static const size_t ForceBatchHeaderSize = 3;
+    // Timestamp and four channels as uint32
+    static const size_t ForceBatchRawSampleSize = 20;
+    // uint16 timestamp step and four int16 channel steps
+    static const size_t ForceBatchDeltaSampleSize = 10;
+    // Keeps a raw batch well inside the uint16 length prefix
+    static const size_t MaxForceBatchSamples = 1024;
+
+    // Largest fixed size packet, enough for a FixedBuffer to build any of them
+    static const size_t MaxFixedPacketSize = PacketFramer::HeaderSize + 2 + 16;
+
+    /************************** Framing ***************************/
+
+    inline void beginPacket(BufferView &out, unsigned short opcode) noexcept {
+        out.clear();
+        out.setWriteOffset(PacketFramer::HeaderSize);
+        out.writeUInt16_LE(opcode);
+    }
+    // Fills in the length prefix reserved by beginPacket
+    inline void finishPacket(BufferView &out) noexcept {
+        out.writeBytesAt<unsigned short>(0, (unsigned short)(out.size() - PacketFramer::HeaderSize));
+    }
+
+    /************************** Server -> device ***************************/
+
+    inline void writePing(BufferView &out, int code) noexcept {
+        beginPacket(out, SendPing);
+        out.writeInt32_LE(code);
+        finishPacket(out);
+    }
+    inline void writeRotationRequest(BufferView &out, const RotatorSample &request) noexcept {
+        beginPacket(out, SendRotationRequest);
+        out.writeUInt16_LE(request.type);
+        out.writeUInt16_LE(request.id);
+        out.writeInt32_LE(request.rotation);
+        finishPacket(out);
+    }
+
+    /************************** Device -> server ***************************/
+
+    inline void writePong(BufferView &out, int code) noexcept {
+        beginPacket(out, RecvPong);
+        out.writeInt32_LE(code);
+        finishPacket(out);
+    }
+    inline void writeForceSensor(BufferView &out, const ForceSample &sample) noexcept {
+        beginPacket(out, RecvForceSensor);
+        out.writeUInt32_LE(sample.front);
+        out.writeUInt32_LE(sample.back);
+        out.writeUInt32_LE(sample.left);
+        out.writeUInt32_LE(sample.right);
+        finishPacket(out);
+    }
+    inline void writeRotator(BufferView &out, const RotatorSample &sample) noexcept {
+        beginPacket(out, RecvRotator);
+        out.writeUInt16_LE(sample.type);
+        out.writeUInt16_LE(sample.id);
+        out.writeInt32_LE(sample.rotation);
+        finishPacket(out);
+    }
+
+    // Packet body size (opcode included) of a batch, the whole packet is HeaderSize more
+    inline size_t forceBatchBodySize(size_t count, bool delta) noexcept {
+        if (count == 0)
+            return 2 + ForceBatchHeaderSize;
+        return 2 + ForceBatchHeaderSize + ForceBatchRawSampleSize + (count - 1) * (delta ? ForceBatchDeltaSampleSize : ForceBatchRawSampleSize);
+    }
+
+    // True when every step between consecutive samples fits the delta encoding
+    inline bool canDeltaEncode(const ForceBatchSample *samples, size_t count) noexcept {
+        for (size_t i = 1; i < count; ++i) {
+            const ForceBatchSample &prev = samples[i - 1];
+            const ForceBatchSample &cur = samples[i];
+            if (cur.timestamp - prev.timestamp > 0xFFFF)
+                return false;
+            const int steps[4] = {
+                (int)(cur.force.front - prev.force.front),
+                (int)(cur.force.back - prev.force.back),
+                (int)(cur.force.left - prev.force.left),
+                (int)(cur.force.right - prev.force.right),
+            };
+            for (int step : steps)
+                if (step < -0x8000 || step > 0x7FFF)
+                    return false;
+        }
+        return true;
+    }
+
+    // At most MaxForceBatchSamples. Delta encoding is only used when requested and every step fits,
+    // the flag tells the reader which one it got
+    inline void writeForceBatch(BufferView &out, const ForceBatchSample *samples, size_t count, bool delta) noexcept {
+        delta = delta && canDeltaEncode(samples, count);
+        beginPacket(out, RecvForceBatch);
+        out.writeUInt16_LE((unsigned short)count);
+        out.writeUInt8(delta ? ForceBatchDelta : 0);
+        for (size_t i = 0; i < count; ++i) {
+            const ForceBatchSample &cur = samples[i];
+            if (delta && i > 0) {
+                const ForceBatchSample &prev = samples[i - 1];
+                out.writeUInt16_LE((unsigned short)(cur.timestamp - prev.timestamp));
+                out.writeInt16_LE((short)(cur.force.front - prev.force.front));
+                out.writeInt16_LE((short)(cur.force.back - prev.force.back));
+                out.writeInt16_LE((short)(cur.force.left - prev.force.left));
+                out.writeInt16_LE((short)(cur.force.right - prev.force.right));
+            } else {
+                out.writeUInt32_LE(cur.timestamp);
+                out.writeUInt32_LE(cur.force.front);
+                out.writeUInt32_LE(cur.force.back);
+                out.writeUInt32_LE(cur.force.left);
+                out.writeUInt32_LE(cur.force.right);
+            }
+        }
+        finishPacket(out);
+    }
+
+    /************************** Datagrams ***************************/
+
+    // A UDP datagram is a sequence number followed by one or more packets framed exactly like on TCP
+    static const size_t DatagramHeaderSize = 4;
+
+    inline void writeDatagramHeader(BufferView &out, unsigned int sequence) noexcept {
+        out.clear();
+        out.writeUInt32_LE(sequence);
+    }
+    inline unsigned int readDatagramSequence(BufferView &in) noexcept {
+        return in.readUInt32_LE();
+    }
+
+    // Packet bodies as handed out by PacketFramer, after the opcode was read
+    inline int readPong(BufferView &in) noexcept {
+        return in.readInt32_LE();
+    }
+    inline ForceSample readForceSensor(BufferView &in) noexcept {
+        ForceSample sample;
+        sample.front = in.readUInt32_LE();
+        sample.back = in.readUInt32_LE();
+        sample.left = in.readUInt32_LE();
+        sample.right = in.readUInt32_LE();
+        return sample;
+    }
+    inline RotatorSample readRotator(BufferView &in) noexcept {
+        RotatorSample sample;
+        sample.type = in.readUInt16_LE();
+        sample.id = in.readUInt16_LE();
+        sample.rotation = in.readInt32_LE();
+        return sample;
+    }
+
+    /*
+        Decodes a RecvForceBatch body in a single pass, calling sink(const ForceBatchSample &)
+        for every sample in order. The size is checked up front, so a malformed packet returns
+        false without handing out any samples.
+    */
+    template <class Sink> inline bool readForceBatch(BufferView &in, Sink &&sink) noexcept {
+        const size_t count = in.readUInt16_LE();
+        const bool delta = (in.readUInt8() & ForceBatchDelta) != 0;
+        if (!in.good() || count == 0 || count > MaxForceBatchSamples)
+            return false;
+        if (in.remaining() != forceBatchBodySize(count, delta) - 2 - ForceBatchHeaderSize)
+            return false;
+
+        ForceBatchSample sample;
+        sample.timestamp = in.readUInt32_LE();
+        sample.force = readForceSensor(in);
+        sink(sample);
+
+        for (size_t i = 1; i < count; ++i) {
+            if (delta) {
+                sample.timestamp += in.readUInt16_LE();
+                sample.force.front += (unsigned int)(int)in.readInt16_LE();
+                sample.force.back += (unsigned int)(int)in.readInt16_LE();
+                sample.force.left += (unsigned int)(int)in.readInt16_LE();
+                sample.force.right += (unsigned int)(int)in.readInt16_LE();
+            } else {
+                sample.timestamp = in.readUInt32_LE();
+                sample.force = readForceSensor(in);
+            }
+            sink(sample);
+        }
+        return true;
+    }
+}
@@ -0,0 +1,70 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Sockets.h"
+
+#include "SocketOptions.generated.h"
+
+/**
+* Socket tuning applied to the listen socket and to every client socket it accepts. Keepalive and busy
+* polling need the native socket path, the module logs at startup whether this build has it.
+*/
+USTRUCT(BlueprintType)
+struct FServerSocketOptions
+{
+	GENERATED_USTRUCT_BODY()
+public:
+	/** Disable Nagle, small sensor and request packets go out immediately instead of waiting for an ACK */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Socket Options")
+	bool bNoDelay = true;
+
+	/** SO_RCVBUF in bytes, 0 keeps the OS default (which also keeps receive window auto-tuning) */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Socket Options", meta = (ClampMin = "0"))
+	int32 ReceiveBufferSize = 0;
+
+	/** SO_SNDBUF in bytes, 0 keeps the OS default */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Socket Options", meta = (ClampMin = "0"))
+	int32 SendBufferSize = 0;
+
+	/** Connections the OS queues before they are accepted */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Socket Options", meta = (ClampMin = "1"))
+	int32 ListenBacklog = 64;
+
+	/** TCP keepalive, notices devices that vanished without closing the connection */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Socket Options")
+	bool bKeepAlive = false;
+
+	/** Idle seconds before the first keepalive probe */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Socket Options", meta = (ClampMin = "1", EditCondition = "bKeepAlive"))
+	int32 KeepAliveIdleSeconds = 10;
+
+	/** Seconds between unanswered probes */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Socket Options", meta = (ClampMin = "1", EditCondition = "bKeepAlive"))
+	int32 KeepAliveIntervalSeconds = 2;
+
+	/** Unanswered probes before the connection is dropped, not configurable on Windows */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Socket Options", meta = (ClampMin = "1", EditCondition = "bKeepAlive"))
+	int32 KeepAliveProbes = 3;
+
+	/**
+	* Linux only, SO_BUSY_POLL in microseconds: a read on an empty socket spins on the NIC queue this long
+	* before sleeping. Trades CPU for latency, values above net.core.busy_read need CAP_NET_ADMIN. 0 is off.
+	*/
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Socket Options", meta = (ClampMin = "0"))
+	int32 BusyPollMicroseconds = 0;
+};
+
+namespace SimlySocketOptions
+{
+	/** Applies everything but the backlog, returns false when an option was refused (the rest are still applied). */
+	SIMLY_API bool Apply(FSocket* Socket, const FServerSocketOptions& Options);
+}
@@ -0,0 +1,89 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Sockets.h"
+
+// epoll on Linux, poll()/WSAPoll everywhere else. Both need native handles, without them
+// (see NativeSocket.h) every socket is checked through FSocket::Wait in 1 ms passes instead
+#define SIMLY_POLLER_EPOLL PLATFORM_LINUX
+
+enum class ESocketPollFlags : uint8
+{
+	None = 0,
+	Readable = 1 << 0,
+	Writable = 1 << 1,
+	Closed = 1 << 2,
+};
+ENUM_CLASS_FLAGS(ESocketPollFlags);
+
+struct FSocketPollEvent
+{
+	void* UserData = nullptr;
+	ESocketPollFlags Flags = ESocketPollFlags::None;
+};
+
+/**
+* Readiness based wait on a set of sockets. Blocks the calling thread until one of the
+* registered sockets becomes readable/writable, the timeout expires or Wakeup() is called.
+*
+* Add/Modify/Remove/Wait must all be called from the thread that owns the poller,
+* Wakeup may be called from any thread.
+*/
+class SIMLY_API FSocketPoller
+{
+public:
+	FSocketPoller();
+	~FSocketPoller();
+
+	bool IsValid() const { return bValid; }
+
+	bool Add(FSocket* Socket, void* UserData, ESocketPollFlags Interest);
+	bool Modify(FSocket* Socket, void* UserData, ESocketPollFlags Interest);
+	void Remove(FSocket* Socket);
+
+	/** Returns the number of events written to OutEvents, 0 on timeout or wakeup. */
+	int32 Wait(TArray<FSocketPollEvent>& OutEvents, FTimespan Timeout);
+
+	/** Interrupt a blocking Wait() from another thread. */
+	void Wakeup();
+
+	/** "epoll", "poll" or "portable", whichever this build compiled in. */
+	static const TCHAR* GetBackendName();
+
+	/**
+	* Non-blocking gather write of two buffers (writev/WSASend), Second may be empty.
+	* Returns false on a socket error, a full send buffer is a success with fewer bytes sent.
+	*/
+	static bool SendGather(FSocket* Socket, const uint8* First, int32 FirstLength, const uint8* Second, int32 SecondLength, int32& BytesSent);
+
+private:
+	struct FRegistration
+	{
+		FSocket* Socket;
+		void* UserData;
+		ESocketPollFlags Interest;
+	};
+
+	void DrainWakeup();
+
+	TArray<FRegistration> Registrations;
+	FSocket* WakeSocket = nullptr;
+	TSharedPtr<FInternetAddr> WakeAddress;
+	FThreadSafeBool bWakePending;
+	bool bValid = false;
+
+#if SIMLY_POLLER_EPOLL
+	int EpollFd = -1;
+	TArray<uint8> NativeEvents;
+#else
+	TArray<uint8> NativeFds;
+#endif
+};
@@ -0,0 +1,80 @@
+/*
+*   Copyright 2022 Kaz Voeten
+*
+*	Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+*	The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+*	THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "LidarPointCloudShared.h"
+#include "PointCloudBuffer.h"
+
+/** Running average of the points that fell into one voxel. */
+struct FVoxelCell
+{
+	FVector Position = FVector::ZeroVector;
+	uint32 RedSum = 0;
+	uint32 GreenSum = 0;
+	uint32 BlueSum = 0;
+	uint32 Count = 0;
+
+	// Samples the point cloud's copy was averaged from, 0 until the voxel is handed out
+	uint32 UploadedCount = 0;
+	bool bUpdated = false;
+};
+
+/**
+* Sparse voxel hash grid that merges scanned points, one averaged point per occupied voxel.
+*
+* Memory grows with the scanned volume instead of the number of frames. Voxels created since the
+* last ConsumePending are tracked so they can be inserted into a point cloud in batches. Voxels that
+* were handed out and have since doubled their sample count are tracked as updated, their average
+* may have moved enough to be worth a refresh.
+*/
+class SIMLY_API FVoxelAccumulator
+{
+public:
+	explicit FVoxelAccumulator(float InVoxelSize = 1.0f) : VoxelSize(InVoxelSize) {}
+
+	/** Changing the size drops everything accumulated so far. */
+	void SetVoxelSize(float InVoxelSize);
+	float GetVoxelSize() const { return VoxelSize; }
+
+	/** Accumulates the valid Points transformed by Transform. */
+	void AddPoints(const FPointCloudBuffer& Points, const FTransform& Transform);
+
+	void Reset();
+
+	int32 NumVoxels() const { return Cells.Num(); }
+	int32 NumPending() const { return PendingKeys.Num(); }
+	int32 NumUpdated() const { return NumUpdatedCells; }
+
+	/** Bounds of every occupied voxel. */
+	const FBox& GetBounds() const { return Bounds; }
+
+	/** Averaged points of the voxels created since the last call. */
+	void ConsumePending(TArray<FLidarPointCloudPoint>& OutPoints);
+
+	/** Averaged points of every voxel, also clears the pending and updated voxels. */
+	void GetAllPoints(TArray<FLidarPointCloudPoint>& OutPoints);
+
+private:
+	struct FQuantizedPoint
+	{
+		FVector Position;
+		FIntVector Key;
+		bool bValid;
+	};
+
+	static FLidarPointCloudPoint ToPoint(FVoxelCell& Cell);
+
+	float VoxelSize;
+	TMap<FIntVector, FVoxelCell> Cells;
+	TArray<FIntVector> PendingKeys;
+	int32 NumUpdatedCells = 0;
+	TArray<FQuantizedPoint> Quantized;
+	FBox Bounds = FBox(ForceInit);
+};
@@ -13,6 +13,17 @@ public class Simly : ModuleRules
         PrivateIncludePaths.AddRange(new string[] { Path.Combine(ModuleDirectory, "Private") });
         PublicIncludePaths.AddRange(new string[] { Path.Combine(ModuleDirectory, "Public") });
 
+        // SocketPoller (epoll/poll) and SocketOptions (keepalive, busy polling) reach the OS handle through
+        // FSocketBSD, which only the Sockets module's private headers declare. Only NativeSocket.cpp includes
+        // it; without the header the module falls back to the portable FSocket path.
+        string SocketsPrivateDirectory = Path.Combine(EngineDirectory, "Source", "Runtime", "Sockets", "Private");
+        bool bNativeSockets = File.Exists(Path.Combine(SocketsPrivateDirectory, "BSDSockets", "SocketsBSD.h"));
+        if (bNativeSockets)
+        {
+            PrivateIncludePaths.Add(SocketsPrivateDirectory);
+        }
+        PrivateDefinitions.Add("SIMLY_NATIVE_SOCKETS=" + (bNativeSockets ? "1" : "0"));
+
         PublicIncludePaths.AddRange(
 			new string[] {
 				// ... add public include paths required here ...
@@ -67,7 +78,8 @@ public class Simly : ModuleRules
 				"Engine",
 				"Slate",
 				"SlateCore",
-                "MediaCompositing"
+                "MediaCompositing",
+                "ImageWrapper"
 				// ... add private dependencies that you statically link with here ...	
 			}
 			);